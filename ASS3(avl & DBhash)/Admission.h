@@ -0,0 +1,162 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Decides whether a new address may displace the entry the replacement
+// policy would evict. A cache without one admits everything.
+class AdmissionPolicy {
+public:
+  virtual ~AdmissionPolicy() {}
+  virtual void record(int /*addr*/) {} // called once per access
+  virtual bool admit(int candidate, int victim) = 0;
+};
+
+inline uint64_t mix64(uint64_t x) { // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// k hashes derived from two halves of one 64-bit hash
+class BloomFilter {
+  static const int HASHES = 4;
+  vector<uint64_t> words;
+  uint64_t mask; // bits - 1, bits a power of two
+
+public:
+  BloomFilter(size_t bits) {
+    size_t n = 64;
+    while (n < bits) {
+      n <<= 1;
+    }
+    words.assign(n / 64, 0);
+    mask = n - 1;
+  }
+  bool contains(int key) const {
+    uint64_t h = mix64((uint32_t)key);
+    uint32_t a = (uint32_t)h, b = (uint32_t)(h >> 32) | 1;
+    for (int i = 0; i < HASHES; i++) {
+      uint64_t bit = (a + (uint64_t)i * b) & mask;
+      if (!(words[bit >> 6] >> (bit & 63) & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  void add(int key) {
+    uint64_t h = mix64((uint32_t)key);
+    uint32_t a = (uint32_t)h, b = (uint32_t)(h >> 32) | 1;
+    for (int i = 0; i < HASHES; i++) {
+      uint64_t bit = (a + (uint64_t)i * b) & mask;
+      words[bit >> 6] |= 1ULL << (bit & 63);
+    }
+  }
+  void clear() { fill(words.begin(), words.end(), 0); }
+};
+
+// Admits an address the second time it asks within a window of about
+// 8 * capacity distinct requests, so one-hit wonders never evict anything.
+class Doorkeeper final : public AdmissionPolicy {
+  BloomFilter seen;
+  int added, window;
+
+public:
+  Doorkeeper(int capacity)
+      : seen((size_t)80 * capacity), added(0), window(8 * capacity) {}
+  bool admit(int candidate, int /*victim*/) {
+    if (seen.contains(candidate)) {
+      return true;
+    }
+    seen.add(candidate);
+    if (++added >= window) {
+      seen.clear();
+      added = 0;
+    }
+    return false;
+  }
+};
+
+// Count-min sketch of 4 rows of saturating 4-bit counts, halved every
+// sampleSize increments so that old popularity fades
+class FrequencySketch {
+  static const int ROWS = 4;
+  vector<uint8_t> table;
+  uint64_t mask;
+  int samples, sampleSize;
+
+  size_t slot(uint64_t h, int row) const {
+    uint32_t a = (uint32_t)h, b = (uint32_t)(h >> 32) | 1;
+    return row * (mask + 1) + ((a + (uint64_t)row * b) & mask);
+  }
+
+public:
+  FrequencySketch(int capacity) : samples(0) {
+    size_t width = 16;
+    while (width < (size_t)capacity) {
+      width <<= 1;
+    }
+    table.assign(ROWS * width, 0);
+    mask = width - 1;
+    sampleSize = 10 * max(capacity, 1);
+  }
+  int estimate(int key) const {
+    uint64_t h = mix64((uint32_t)key);
+    int least = 15;
+    for (int r = 0; r < ROWS; r++) {
+      least = min<int>(least, table[slot(h, r)]);
+    }
+    return least;
+  }
+  // true when this increment halved the counts
+  bool increment(int key) {
+    uint64_t h = mix64((uint32_t)key);
+    for (int r = 0; r < ROWS; r++) {
+      uint8_t &c = table[slot(h, r)];
+      c += c < 15;
+    }
+    if (++samples < sampleSize) {
+      return false;
+    }
+    for (uint8_t &c : table) {
+      c >>= 1;
+    }
+    samples /= 2;
+    return true;
+  }
+};
+
+// TinyLFU (Einziger et al.): a candidate is admitted only if it has been
+// requested more often than the victim recently. The first request of an
+// address only sets its doorkeeper bit, which keeps one-hit wonders out
+// of the sketch.
+class TinyLFU final : public AdmissionPolicy {
+  FrequencySketch sketch;
+  BloomFilter door;
+
+  int frequency(int addr) {
+    return sketch.estimate(addr) + door.contains(addr);
+  }
+
+public:
+  TinyLFU(int capacity) : sketch(capacity), door((size_t)16 * capacity) {}
+  void record(int addr) {
+    if (!door.contains(addr)) {
+      door.add(addr);
+    } else if (sketch.increment(addr)) {
+      door.clear();
+    }
+  }
+  bool admit(int candidate, int victim) {
+    return frequency(candidate) > frequency(victim);
+  }
+};
+
+#endif
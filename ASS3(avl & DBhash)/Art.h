@@ -0,0 +1,471 @@
+#ifndef ART_H
+#define ART_H
+
+#include "Cache.h"
+#include <type_traits>
+
+// Adaptive radix tree (Leis, Kemper and Neumann, "The Adaptive Radix
+// Tree"). An address is turned into big-endian bytes with the sign bit
+// flipped, so byte order is address order, and each inner node branches
+// on one byte. Inner nodes come in four sizes and change size as children
+// come and go: Node4 and Node16 keep sorted byte arrays, Node16 searched
+// with one SSE2 compare; Node48 maps a byte to one of 48 children; Node256
+// indexes its children directly. A node also keeps the bytes every key
+// below it shares (path compression), so a lookup visits at most one node
+// per byte where keys differ. Lookups skip those bytes and compare the
+// whole key once at the leaf. A key inserted again gets a leaf chained
+// behind the first, as AVL keeps both nodes: lookups find the first, and
+// a delete removes it so the next one is found.
+//
+// Key is the address type. Only the SearchEngine calls fix it to int, so
+// a 64-bit Elem::addr needs ArtEngine<int64_t> and nothing else here.
+template <class Key> class ArtEngine final : public SearchEngine {
+  static_assert(sizeof(Key) <= 8, "keys are at most 8 bytes");
+  static const int BYTES = sizeof(Key);
+  enum Type : uint8_t { LEAF, NODE4, NODE16, NODE48, NODE256 };
+
+  struct Node {
+    Type type;
+    uint8_t prefixLen;
+    uint16_t count;     // children
+    uint8_t prefix[8];  // bytes shared by every key below
+  };
+  struct Leaf : Node {
+    uint64_t code; // encode(address)
+    int idx;
+    Leaf *dup; // a later entry with the same key
+  };
+  struct Node4 : Node {
+    uint8_t keys[4];
+    Node *child[4];
+  };
+  struct Node16 : Node {
+    uint8_t keys[16];
+    Node *child[16];
+  };
+  struct Node48 : Node {
+    uint8_t index[256]; // slot + 1 of the child for a byte, 0 if none
+    Node *child[48];
+  };
+  struct Node256 : Node {
+    Node *child[256];
+  };
+
+  Node *root;
+
+  static uint64_t encode(Key address) {
+    typedef typename make_unsigned<Key>::type Bits;
+    return (uint64_t)(Bits)address ^ ((uint64_t)1 << (8 * BYTES - 1));
+  }
+  static uint8_t byteAt(uint64_t code, int depth) {
+    return (uint8_t)(code >> (8 * (BYTES - 1 - depth)));
+  }
+  // smallest and largest codes of the keys that start with the depth
+  // bytes of prefix
+  static uint64_t lowest(uint64_t prefix, int depth) {
+    int span = BYTES - depth;
+    return (span < 8) ? prefix << (8 * span) : 0;
+  }
+  static uint64_t highest(uint64_t prefix, int depth) {
+    int span = BYTES - depth;
+    return lowest(prefix, depth) |
+           ((span < 8) ? ((uint64_t)1 << (8 * span)) - 1 : ~(uint64_t)0);
+  }
+
+  template <class N> static N *make(Type type) {
+    N *n = new N();
+    n->type = type;
+    return n;
+  }
+  static Leaf *makeLeaf(uint64_t code, int idx) {
+    Leaf *leaf = make<Leaf>(LEAF);
+    leaf->code = code;
+    leaf->idx = idx;
+    leaf->dup = nullptr;
+    return leaf;
+  }
+  static void destroy(Node *n) {
+    switch (n->type) {
+    case LEAF:
+      delete (Leaf *)n;
+      break;
+    case NODE4:
+      delete (Node4 *)n;
+      break;
+    case NODE16:
+      delete (Node16 *)n;
+      break;
+    case NODE48:
+      delete (Node48 *)n;
+      break;
+    default:
+      delete (Node256 *)n;
+    }
+  }
+
+  // the slot holding the child for byte b, nullptr if there is none
+  static Node **findChild(Node *n, uint8_t b) {
+    switch (n->type) {
+    case NODE4: {
+      Node4 *n4 = (Node4 *)n;
+      for (int i = 0; i < n->count; i++) {
+        if (n4->keys[i] == b) {
+          return &n4->child[i];
+        }
+      }
+      return nullptr;
+    }
+    case NODE16: {
+      Node16 *n16 = (Node16 *)n;
+#if defined(__SSE2__)
+      __m128i keys = _mm_loadu_si128((const __m128i *)n16->keys);
+      int bits = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8(b)));
+      bits &= (1 << n->count) - 1;
+      return (bits != 0) ? &n16->child[lowestBit(bits)] : nullptr;
+#else
+      for (int i = 0; i < n->count; i++) {
+        if (n16->keys[i] == b) {
+          return &n16->child[i];
+        }
+      }
+      return nullptr;
+#endif
+    }
+    case NODE48: {
+      Node48 *n48 = (Node48 *)n;
+      return (n48->index[b] != 0) ? &n48->child[n48->index[b] - 1] : nullptr;
+    }
+    case NODE256: {
+      Node256 *n256 = (Node256 *)n;
+      return (n256->child[b] != nullptr) ? &n256->child[b] : nullptr;
+    }
+    default:
+      return nullptr;
+    }
+  }
+  // calls f(byte, child) for every child of n in byte order
+  template <class F> static void children(Node *n, F f) {
+    switch (n->type) {
+    case NODE4:
+      for (int i = 0; i < n->count; i++) {
+        f(((Node4 *)n)->keys[i], ((Node4 *)n)->child[i]);
+      }
+      break;
+    case NODE16:
+      for (int i = 0; i < n->count; i++) {
+        f(((Node16 *)n)->keys[i], ((Node16 *)n)->child[i]);
+      }
+      break;
+    case NODE48:
+      for (int b = 0; b < 256; b++) {
+        Node48 *n48 = (Node48 *)n;
+        if (n48->index[b] != 0) {
+          f((uint8_t)b, n48->child[n48->index[b] - 1]);
+        }
+      }
+      break;
+    case NODE256:
+      for (int b = 0; b < 256; b++) {
+        if (((Node256 *)n)->child[b] != nullptr) {
+          f((uint8_t)b, ((Node256 *)n)->child[b]);
+        }
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  template <class N> static void putSorted(N *n, uint8_t b, Node *child) {
+    int i = n->count;
+    for (; i > 0 && n->keys[i - 1] > b; i--) {
+      n->keys[i] = n->keys[i - 1];
+      n->child[i] = n->child[i - 1];
+    }
+    n->keys[i] = b;
+    n->child[i] = child;
+  }
+  template <class N> static void eraseSorted(N *n, uint8_t b) {
+    int i = 0;
+    while (n->keys[i] != b) {
+      i++;
+    }
+    for (; i + 1 < n->count; i++) {
+      n->keys[i] = n->keys[i + 1];
+      n->child[i] = n->child[i + 1];
+    }
+  }
+  // adds a child to n, which has room for it
+  static void put(Node *n, uint8_t b, Node *child) {
+    if (n->type == NODE4) {
+      putSorted((Node4 *)n, b, child);
+    } else if (n->type == NODE16) {
+      putSorted((Node16 *)n, b, child);
+    } else if (n->type == NODE48) {
+      Node48 *n48 = (Node48 *)n;
+      int slot = 0;
+      while (n48->child[slot] != nullptr) {
+        slot++;
+      }
+      n48->child[slot] = child;
+      n48->index[b] = slot + 1;
+    } else {
+      ((Node256 *)n)->child[b] = child;
+    }
+    n->count++;
+  }
+  static void erase(Node *n, uint8_t b) {
+    if (n->type == NODE4) {
+      eraseSorted((Node4 *)n, b);
+    } else if (n->type == NODE16) {
+      eraseSorted((Node16 *)n, b);
+    } else if (n->type == NODE48) {
+      Node48 *n48 = (Node48 *)n;
+      n48->child[n48->index[b] - 1] = nullptr;
+      n48->index[b] = 0;
+    } else {
+      ((Node256 *)n)->child[b] = nullptr;
+    }
+    n->count--;
+  }
+  // a copy of n as type, which must hold all its children; frees n
+  static Node *resize(Node *n, Type type) {
+    Node *to;
+    if (type == NODE4) {
+      to = make<Node4>(type);
+    } else if (type == NODE16) {
+      to = make<Node16>(type);
+    } else if (type == NODE48) {
+      to = make<Node48>(type);
+    } else {
+      to = make<Node256>(type);
+    }
+    to->prefixLen = n->prefixLen;
+    memcpy(to->prefix, n->prefix, sizeof(n->prefix));
+    children(n, [&](uint8_t b, Node *child) { put(to, b, child); });
+    destroy(n);
+    return to;
+  }
+  static int capacity(Node *n) {
+    static const int sizes[] = {0, 4, 16, 48, 256};
+    return sizes[n->type];
+  }
+  static void addChild(Node *&ref, uint8_t b, Node *child) {
+    if (ref->count == capacity(ref)) {
+      ref = resize(ref, (Type)(ref->type + 1));
+    }
+    put(ref, b, child);
+  }
+  // removes the child for b, shrinking ref or merging it into its only
+  // child once it has few enough
+  static void removeChild(Node *&ref, uint8_t b) {
+    Node *n = ref;
+    erase(n, b);
+    if (n->type == NODE4 && n->count == 1) {
+      Node *only = ((Node4 *)n)->child[0];
+      if (only->type != LEAF) {
+        uint8_t prefix[8];
+        int len = n->prefixLen;
+        memcpy(prefix, n->prefix, len);
+        prefix[len++] = ((Node4 *)n)->keys[0];
+        memcpy(prefix + len, only->prefix, only->prefixLen);
+        only->prefixLen += len;
+        memcpy(only->prefix, prefix, only->prefixLen);
+      }
+      destroy(n);
+      ref = only;
+    } else if ((n->type == NODE16 && n->count <= 3) ||
+               (n->type == NODE48 && n->count <= 12) ||
+               (n->type == NODE256 && n->count <= 37)) {
+      ref = resize(n, (Type)(n->type - 1));
+    }
+  }
+
+  void insert(Node *&ref, uint64_t code, int depth, int idx) {
+    Node *n = ref;
+    if (n == nullptr) {
+      ref = makeLeaf(code, idx);
+      return;
+    }
+    if (n->type == LEAF) {
+      Leaf *leaf = (Leaf *)n;
+      if (leaf->code == code) {
+        while (leaf->dup != nullptr) {
+          leaf = leaf->dup;
+        }
+        leaf->dup = makeLeaf(code, idx);
+        return;
+      }
+      // a new node for the bytes both keys share, then the first byte
+      // where they differ
+      Node4 *node = make<Node4>(NODE4);
+      while (byteAt(leaf->code, depth) == byteAt(code, depth)) {
+        node->prefix[node->prefixLen++] = byteAt(code, depth++);
+      }
+      put(node, byteAt(leaf->code, depth), leaf);
+      put(node, byteAt(code, depth), makeLeaf(code, idx));
+      ref = node;
+      return;
+    }
+    int p = 0;
+    while (p < n->prefixLen && n->prefix[p] == byteAt(code, depth + p)) {
+      p++;
+    }
+    if (p < n->prefixLen) { // split the prefix where the key leaves it
+      Node4 *node = make<Node4>(NODE4);
+      node->prefixLen = p;
+      memcpy(node->prefix, n->prefix, p);
+      uint8_t b = n->prefix[p];
+      n->prefixLen -= p + 1;
+      memmove(n->prefix, n->prefix + p + 1, n->prefixLen);
+      put(node, b, n);
+      put(node, byteAt(code, depth + p), makeLeaf(code, idx));
+      ref = node;
+      return;
+    }
+    depth += n->prefixLen;
+    Node **child = findChild(n, byteAt(code, depth));
+    if (child != nullptr) {
+      insert(*child, code, depth + 1, idx);
+    } else {
+      addChild(ref, byteAt(code, depth), makeLeaf(code, idx));
+    }
+  }
+  // replaces the leaf at ref by its next duplicate, nullptr if none
+  static void removeFirst(Node *&ref) {
+    Leaf *leaf = (Leaf *)ref;
+    ref = leaf->dup;
+    destroy(leaf);
+  }
+  void remove(Node *&ref, uint64_t code, int depth) {
+    Node *n = ref;
+    if (n == nullptr) {
+      return;
+    }
+    if (n->type == LEAF) { // only a leaf at the root gets here
+      if (((Leaf *)n)->code == code) {
+        removeFirst(ref);
+      }
+      return;
+    }
+    depth += n->prefixLen;
+    uint8_t b = byteAt(code, depth);
+    Node **child = findChild(n, b);
+    if (child == nullptr) {
+      return;
+    }
+    if ((*child)->type != LEAF) {
+      remove(*child, code, depth + 1);
+    } else if (((Leaf *)*child)->code == code) {
+      removeFirst(*child);
+      if (*child == nullptr) {
+        removeChild(ref, b);
+      }
+    }
+  }
+  Leaf *find(Key address) {
+    uint64_t code = encode(address);
+    Node *n = root;
+    for (int depth = 0; n != nullptr && n->type != LEAF;) {
+      depth += n->prefixLen; // checked once at the leaf
+      Node **child = findChild(n, byteAt(code, depth++));
+      n = (child != nullptr) ? *child : nullptr;
+    }
+    Leaf *leaf = (Leaf *)n;
+    return (leaf != nullptr && leaf->code == code) ? leaf : nullptr;
+  }
+
+  void clear(Node *n) {
+    if (n == nullptr) {
+      return;
+    }
+    if (n->type == LEAF) {
+      clear(((Leaf *)n)->dup);
+    }
+    children(n, [&](uint8_t, Node *child) { clear(child); });
+    destroy(n);
+  }
+  void inOrder(ReplacementPolicy *q, Node *n, ostream &os) {
+    if (n == nullptr) {
+      return;
+    }
+    for (Leaf *leaf = (Leaf *)n; n->type == LEAF && leaf; leaf = leaf->dup) {
+      q->getValue(leaf->idx)->print(os);
+    }
+    children(n, [&](uint8_t, Node *child) { inOrder(q, child, os); });
+  }
+  // prefix: the depth bytes on the path to n
+  void scan(Node *n, uint64_t prefix, int depth, uint64_t lo, uint64_t hi,
+            vector<int> &idx) {
+    if (n->type == LEAF) {
+      uint64_t code = ((Leaf *)n)->code;
+      for (Leaf *leaf = (Leaf *)n; lo <= code && code <= hi && leaf;
+           leaf = leaf->dup) {
+        idx.push_back(leaf->idx);
+      }
+      return;
+    }
+    for (int i = 0; i < n->prefixLen; i++) {
+      prefix = (prefix << 8) | n->prefix[i];
+    }
+    depth += n->prefixLen + 1;
+    children(n, [&](uint8_t b, Node *child) {
+      uint64_t next = (prefix << 8) | b;
+      if (highest(next, depth) >= lo && lowest(next, depth) <= hi) {
+        scan(child, next, depth, lo, hi, idx);
+      }
+    });
+  }
+  void measure(Node *n, int depth, EngineStats &out, long long &sum) {
+    if (n == nullptr) {
+      return;
+    }
+    out.height = max(out.height, depth);
+    for (Leaf *leaf = (Leaf *)n; n->type == LEAF && leaf; leaf = leaf->dup) {
+      out.entries++;
+      sum += depth;
+    }
+    children(n, [&](uint8_t, Node *child) {
+      measure(child, depth + 1, out, sum);
+    });
+  }
+
+public:
+  ArtEngine() : root(nullptr) {}
+  ~ArtEngine() { clear(root); }
+
+  int search(int address) {
+    Leaf *leaf = find(address);
+    return (leaf != nullptr) ? leaf->idx : -1;
+  }
+  void insert(Elem *e, int idx) { insert(root, encode(e->addr), 0, idx); }
+  void deleteNode(Elem *e) {
+    if (e != nullptr)
+      remove(root, encode(e->addr), 0);
+  }
+  void relocate(Elem *e, int idx) {
+    Leaf *leaf = find(e->addr);
+    if (leaf != nullptr) {
+      leaf->idx = idx;
+    }
+  }
+  void print(ReplacementPolicy *q, ostream &os) {
+    os << "Print ART in order:" << endl;
+    inOrder(q, root, os);
+  }
+  bool scan(int lo, int hi, vector<int> &idx) {
+    if (root != nullptr && lo <= hi) {
+      scan(root, 0, 0, encode(lo), encode(hi), idx);
+    }
+    return true;
+  }
+  void diagnose(EngineStats &out) {
+    long long sum = 0;
+    measure(root, 1, out, sum);
+    out.avgDepth = out.entries ? (double)sum / out.entries : 0;
+  }
+};
+
+typedef ArtEngine<int> ART;
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+// C++20: co_await cache.readAsync(addr) from coroutines run by a
+// single-threaded Executor, with misses loaded through an AsyncStore
+
+#include "Cache.h"
+#include "Store.h"
+#include <coroutine>
+#include <unordered_map>
+
+// A detached coroutine: it starts when an Executor is given it and frees
+// itself when it returns
+struct Task {
+  struct promise_type {
+    Task get_return_object() {
+      return Task{coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    suspend_always initial_suspend() noexcept { return {}; }
+    suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { terminate(); }
+  };
+  coroutine_handle<promise_type> handle;
+};
+
+// Resumes coroutines one at a time on the thread that calls run(). When
+// none is ready it waits on the store for the next finished load.
+class Executor {
+  deque<coroutine_handle<>> ready;
+  AsyncStore *store;
+
+public:
+  Executor(AsyncStore *s) : store(s) {}
+  void spawn(Task t) { ready.push_back(t.handle); }
+  void post(coroutine_handle<> h) { ready.push_back(h); }
+  // until every coroutine has finished or waits on nothing in flight
+  void run() {
+    while (true) {
+      while (!ready.empty()) {
+        coroutine_handle<> h = ready.front();
+        ready.pop_front();
+        h.resume();
+      }
+      if (store == nullptr || store->inFlight() == 0) {
+        return;
+      }
+      store->wait(true);
+    }
+  }
+  AsyncStore *getStore() { return store; }
+};
+
+// Read-through over a Cache: a miss suspends the coroutine while the
+// store loads the value, then puts it into the cache. Misses on the same
+// address share one load. A read returns a copy of the value that the
+// coroutine owns and deletes: other coroutines run before it resumes and
+// may evict the cache's entry.
+class AsyncCache {
+public:
+  struct ReadAwaiter;
+
+private:
+  struct Load : LoadRequest {
+    AsyncCache *owner;
+    vector<ReadAwaiter *> waiters;
+    bool superseded; // written while loading, the load is stale
+  };
+
+public:
+  struct ReadAwaiter {
+    AsyncCache *owner;
+    int addr;
+    Data *result;
+    coroutine_handle<> handle;
+
+    bool await_ready() {
+      result = own(owner->cache->read(addr));
+      return result != nullptr;
+    }
+    void await_suspend(coroutine_handle<> h) {
+      handle = h;
+      owner->load(this);
+    }
+    Data *await_resume() { return result; }
+  };
+
+private:
+  Cache *cache;
+  Executor &exec;
+  unordered_map<int, Load *> loading;
+  vector<Elem *> *sink;
+  uint64_t loads, shared;
+  int peak; // most loads in flight at once
+
+  static Data *own(Data *data) { // a copy, sharing the bytes of a String
+    if (data == nullptr) {
+      return nullptr;
+    }
+    SharedBuffer bytes = data->share();
+    if (data->getType() == STRING_DATA) {
+      return new String(move(bytes));
+    } else if (data->getType() == BLOB_DATA) {
+      return new Blob(move(bytes));
+    }
+    return makeData(data->getType(), bytes.data(), bytes.size());
+  }
+
+  void load(ReadAwaiter *w) {
+    auto found = loading.find(w->addr);
+    if (found != loading.end()) {
+      found->second->waiters.push_back(w);
+      shared++;
+      return;
+    }
+    Load *l = new Load();
+    l->addr = w->addr;
+    l->complete = &AsyncCache::loaded;
+    l->owner = this;
+    l->waiters.push_back(w);
+    l->superseded = false;
+    loading[w->addr] = l;
+    loads++;
+    peak = max(peak, (int)loading.size());
+    exec.getStore()->submit(l);
+  }
+  static void loaded(LoadRequest *r) {
+    Load *l = (Load *)r;
+    AsyncCache *self = l->owner;
+    self->loading.erase(l->addr);
+    Data *data = nullptr;
+    if (l->superseded) {
+      data = self->cache->read(l->addr);
+    } else if (l->found) {
+      data = new Int(l->bits);
+    }
+    // copies first: put frees data if it is not admitted, and either way
+    // data may be evicted before a waiter resumes
+    for (ReadAwaiter *w : l->waiters) {
+      w->result = own(data);
+    }
+    if (!l->superseded && data != nullptr) {
+      Elem *victim = self->cache->put(l->addr, data);
+      if (victim != nullptr && self->sink != nullptr) {
+        self->sink->push_back(victim);
+      } else {
+        delete victim;
+      }
+    }
+    for (ReadAwaiter *w : l->waiters) {
+      self->exec.post(w->handle);
+    }
+    delete l;
+  }
+
+public:
+  AsyncCache(Cache *c, Executor &e)
+      : cache(c), exec(e), sink(nullptr), loads(0), shared(0), peak(0) {}
+  ~AsyncCache() { // loads still in flight would call into a dead cache
+    while (!loading.empty()) {
+      exec.getStore()->wait(true);
+    }
+  }
+  // nullptr if the store does not have addr either, else the caller's
+  ReadAwaiter readAsync(int addr) { return {this, addr, nullptr, {}}; }
+  // a write makes a load of the same address in flight stale
+  Elem *write(int addr, Data *cont) {
+    auto found = loading.find(addr);
+    if (found != loading.end()) {
+      found->second->superseded = true;
+    }
+    return cache->write(addr, cont);
+  }
+  // where victims of loaded values go; freed without one
+  void collectEvictions(vector<Elem *> *s) { sink = s; }
+  uint64_t getLoads() { return loads; }
+  uint64_t getSharedLoads() { return shared; }
+  int getPeakInFlight() { return peak; }
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <string>
+
+using namespace std;
+
+// Immutable bytes shared by reference count. Copying one only bumps the
+// count, so a reader can keep the value it got from the cache after the
+// entry is overwritten or evicted. Up to INLINE bytes are kept in the
+// object itself and copied instead, which costs less than a count.
+class SharedBuffer {
+public:
+  static const size_t INLINE = 23;
+
+private:
+  struct Block { // header of the heap allocation, the bytes follow it
+    atomic<int> refs;
+    size_t size;
+    unsigned char *bytes() { return (unsigned char *)(this + 1); }
+  };
+  union {
+    Block *block;
+    unsigned char local[INLINE];
+  };
+  unsigned char localSize; // INLINE + 1: the bytes are in block
+
+  bool shared() const { return localSize > INLINE; }
+  void allocate(size_t n) {
+    if (n <= INLINE) {
+      localSize = (unsigned char)n;
+      return;
+    }
+    block = new (::operator new(sizeof(Block) + n)) Block();
+    block->refs.store(1, memory_order_relaxed);
+    block->size = n;
+    localSize = INLINE + 1;
+  }
+  void release() {
+    if (shared() && block->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+      block->~Block();
+      ::operator delete(block);
+    }
+    localSize = 0;
+  }
+
+public:
+  SharedBuffer() : localSize(0) {}
+  SharedBuffer(const void *bytes, size_t n) {
+    allocate(n);
+    if (n > 0) {
+      memcpy(fill(), bytes, n);
+    }
+  }
+  explicit SharedBuffer(const string &s) : SharedBuffer(s.data(), s.size()) {}
+  // n uninitialized bytes for the owner to write through fill()
+  explicit SharedBuffer(size_t n) { allocate(n); }
+  SharedBuffer(const SharedBuffer &other) : localSize(other.localSize) {
+    if (shared()) {
+      block = other.block;
+      block->refs.fetch_add(1, memory_order_relaxed);
+    } else {
+      memcpy(local, other.local, localSize);
+    }
+  }
+  SharedBuffer(SharedBuffer &&other) : localSize(other.localSize) {
+    if (shared()) {
+      block = other.block;
+    } else {
+      memcpy(local, other.local, localSize);
+    }
+    other.localSize = 0;
+  }
+  SharedBuffer &operator=(const SharedBuffer &other) {
+    if (this != &other) {
+      SharedBuffer copy(other);
+      *this = move(copy);
+    }
+    return *this;
+  }
+  SharedBuffer &operator=(SharedBuffer &&other) {
+    if (this != &other) {
+      release();
+      localSize = other.localSize;
+      if (shared()) {
+        block = other.block;
+      } else {
+        memcpy(local, other.local, localSize);
+      }
+      other.localSize = 0;
+    }
+    return *this;
+  }
+  ~SharedBuffer() { release(); }
+
+  const unsigned char *data() const {
+    return shared() ? block->bytes() : local;
+  }
+  size_t size() const { return shared() ? block->size : localSize; }
+  bool empty() const { return size() == 0; }
+  string str() const { return string((const char *)data(), size()); }
+  bool isInline() const { return !shared(); }
+  int useCount() const { // 1 for inline bytes
+    return shared() ? block->refs.load(memory_order_relaxed) : 1;
+  }
+  // the bytes to write while nothing else shares them, nullptr after that
+  unsigned char *fill() {
+    if (!shared()) {
+      return local;
+    }
+    return (useCount() == 1) ? block->bytes() : nullptr;
+  }
+};
+
+#endif
@@ -1,49 +1,289 @@
 #include "Cache.h"
+#include "Art.h"
+#include "Cuckoo.h"
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1 // restore maps snapshots in place, snapshot fsyncs them
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-Cache::Cache(SearchEngine *s, ReplacementPolicy *r) : rp(r), s_engine(s) {}
-Cache::~Cache() {
-  delete rp;
-  delete s_engine;
-}
-
-Data *Cache::read(int addr) {
-  int idx = s_engine->search(addr);
-  Elem *searched = rp->getValue(idx);
-  rp->access(idx);
-  return (searched != nullptr) ? searched->data : nullptr;
-}
-
-Elem *Cache::put(int addr, Data *cont) {
-  int idx = rp->remove();
-  Elem *deleted = rp->getValue(idx);
-  s_engine->deleteNode(deleted);
-  Elem *inserted = new Elem(addr, cont, true);
-  idx = rp->insert(inserted, idx);
-  s_engine->insert(inserted, idx);
-  return deleted;
-}
-
-Elem *Cache::write(int addr, Data *cont) {
-  int idx = s_engine->search(addr);
-  Elem *searched = rp->getValue(idx);
-  Elem *deleted = nullptr;
-  if (searched != nullptr) {
-    rp->access(idx);
-    Data *data = searched->data;
-    searched->data = cont;
-    searched->sync = false;
-    delete data;
-  } else {
-    idx = rp->remove();
-    deleted = rp->getValue(idx);
-    s_engine->deleteNode(deleted);
-    Elem *inserted = new Elem(addr, cont, false);
-    idx = rp->insert(inserted, idx);
-    s_engine->insert(inserted, idx);
-  }
-  return deleted;
-}
-
-void Cache::printRP() { rp->print(); }
-
-void Cache::printSE() { s_engine->print(rp); }
+template <int (*H1)(int)> SearchEngine *makeDBHashing(char hash2, int size) {
+  switch (hash2) {
+  case '1':
+    return new StaticDBHashing<H1, h1>(size);
+  case '2':
+    return new StaticDBHashing<H1, h2>(size);
+  case '3':
+    return new StaticDBHashing<H1, h3>(size);
+  default:
+    return new StaticDBHashing<H1, h4>(size);
+  }
+}
+
+// hash1/hash2 are the digits of the S command, e.g. S D13 31
+SearchEngine *makeDBHashing(char hash1, char hash2, int size) {
+  switch (hash1) {
+  case '1':
+    return makeDBHashing<h1>(hash2, size);
+  case '2':
+    return makeDBHashing<h2>(hash2, size);
+  case '3':
+    return makeDBHashing<h3>(hash2, size);
+  default:
+    return makeDBHashing<h4>(hash2, size);
+  }
+}
+
+// engines and policies by name for the tools; a DBHashing table is sized
+// at twice the capacity, a Cuckoo table at a quarter more
+SearchEngine *makeEngine(const string &name, int capacity) {
+  if (name == "AVL") {
+    return new AVL();
+  } else if (name == "ART") {
+    return new ART();
+  } else if (name == "Cuckoo") {
+    return new CuckooEngine(capacity + capacity / 4);
+  }
+  return makeDBHashing('1', '2', nextPrime(2 * capacity));
+}
+
+ReplacementPolicy *makePolicy(const string &name, int capacity) {
+  if (name == "LRU") {
+    return new LRU(capacity);
+  } else if (name == "LFU") {
+    return new LFU(capacity);
+  } else if (name == "FIFO") {
+    return new FIFO(capacity);
+  }
+  return new MRU(capacity);
+}
+
+// doorkeeper, tinylfu, or nullptr for anything else (admit everything)
+AdmissionPolicy *makeAdmission(const string &name, int capacity) {
+  if (name == "doorkeeper") {
+    return new Doorkeeper(capacity);
+  } else if (name == "tinylfu") {
+    return new TinyLFU(capacity);
+  }
+  return nullptr;
+}
+
+Cache::Cache(SearchEngine *s, ReplacementPolicy *r)
+    : BasicCache<SearchEngine, ReplacementPolicy>(s, r) {}
+
+void Cache::putMany(int *addr, Data **cont, int n) {
+  // fill the free slots in one pass, then fall back to evicting puts; the
+  // pass is counted as its puts would be, each taking an equal share of it
+  uint64_t start = ticks();
+  vector<Elem *> inserted;
+  vector<int> idx;
+  for (int i = 0; i < n && !rp->isFull() && budget == 0; i++) {
+    if (spill != nullptr) {
+      spill->erase(addr[i]);
+    }
+    if (admission != nullptr && !(missPending && missedAddr == addr[i])) {
+      admission->record(addr[i]);
+    }
+    missPending = false;
+    inserted.push_back(new Elem(addr[i], cont[i], true));
+    idx.push_back(rp->insert(inserted.back(), -1));
+  }
+  int loaded = (int)inserted.size();
+  s_engine->bulkInsert(inserted.data(), idx.data(), loaded);
+  counters.puts += loaded;
+  uint64_t share = (loaded > 0) ? (ticks() - start) / loaded : 0;
+  for (int i = 0; i < loaded; i++) {
+    counters.putLatency.record(share);
+  }
+  for (int i = loaded; i < n; i++) {
+    put(addr[i], cont[i]);
+  }
+}
+
+void Cache::readBatch(const int *addr, int n, Data **out) {
+  // reads never move entries, so all lookups can run before the accesses
+  uint64_t start = ticks();
+  for (int i = 0; mrc != nullptr && i < n; i++) {
+    mrc->access(addr[i]);
+  }
+  for (int i = 0; admission != nullptr && i < n; i++) {
+    admission->record(addr[i]);
+  }
+  missPending = false;
+  vector<int> idx(n);
+  s_engine->searchBatch(addr, n, idx.data());
+  for (int i = 0; i < n; i++) {
+    Elem *searched = rp->getValue(idx[i]);
+    rp->access(idx[i]);
+    out[i] = (searched != nullptr) ? searched->data : nullptr;
+    counters.readHits += searched != nullptr;
+  }
+  // a promotion evicts, which can free what an earlier address returned,
+  // as a read() between the two would
+  for (int i = 0; spill != nullptr && i < n; i++) {
+    if (out[i] == nullptr) {
+      out[i] = promote(addr[i]);
+    }
+  }
+  counters.reads += n;
+  uint64_t each = (n > 0) ? (ticks() - start) / n : 0;
+  for (int i = 0; i < n; i++) {
+    counters.readLatency.record(each); // amortized over the batch
+  }
+}
+
+void Cache::writeBatch(const int *addr, Data **cont, int n, Elem **deleted) {
+  // a write miss evicts, so only the prefetches are hoisted out of order
+  for (int base = 0; base < n; base += PREFETCH_GROUP) {
+    int m = min(PREFETCH_GROUP, n - base);
+    for (int j = 0; j < m; j++) {
+      s_engine->prefetch(addr[base + j]);
+    }
+    for (int j = 0; j < m; j++) {
+      Elem *e = write(addr[base + j], cont[base + j]);
+      if (deleted != nullptr) {
+        deleted[base + j] = e;
+      }
+    }
+  }
+}
+
+bool Cache::snapshot(const string &path, bool withEngine) {
+  vector<SnapshotElem> elems;
+  int capacity = rp->getCapacity();
+  if (budget > 0) {
+    return false; // slot numbers and sizes change under a byte budget
+  }
+  for (int i = 0; i < capacity; i++) {
+    Elem *e = rp->getValue(i);
+    if (e != nullptr && e->data->getType() > ADDRESS_DATA) {
+      return false; // no room for the value in a SnapshotElem
+    }
+    if (e != nullptr) {
+      SnapshotElem rec = {i, e->addr, e->data->getBits(),
+                          (char)e->data->getType(), (char)e->sync, {0, 0}};
+      elems.push_back(rec);
+    }
+  }
+  vector<int> policy, engine;
+  rp->dump(policy);
+  if (withEngine) {
+    s_engine->dump(engine);
+  }
+  SnapshotHeader header = {{0},
+                           SNAPSHOT_VERSION,
+                           capacity,
+                           (int)elems.size(),
+                           (int)policy.size(),
+                           (int)engine.size()};
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  ofstream ofs(path, ios::binary | ios::trunc);
+  ofs.write((const char *)&header, sizeof(header));
+  ofs.write((const char *)elems.data(), elems.size() * sizeof(SnapshotElem));
+  ofs.write((const char *)policy.data(), policy.size() * sizeof(int));
+  ofs.write((const char *)engine.data(), engine.size() * sizeof(int));
+  ofs.close();
+  if (!ofs.good()) {
+    return false;
+  }
+  if (wal == nullptr) {
+    return true;
+  }
+  // durable before the caller truncates the log on the strength of it
+#ifdef HAVE_MMAP
+  int fd = open(path.c_str(), O_RDONLY);
+  bool synced = fd >= 0 && fsync(fd) == 0;
+  if (fd >= 0) {
+    close(fd);
+  }
+  return synced;
+#else
+  return true;
+#endif
+}
+
+bool Cache::restore(const string &path) {
+  if (!rp->isEmpty() || budget > 0) {
+    return false;
+  }
+#ifdef HAVE_MMAP
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+    close(fd);
+    return false;
+  }
+  size_t length = st.st_size;
+  void *file = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (file == MAP_FAILED) {
+    return false;
+  }
+#else
+  ifstream ifs(path, ios::binary | ios::ate);
+  size_t length = ifs ? (size_t)ifs.tellg() : 0;
+  vector<int> words((length + sizeof(int) - 1) / sizeof(int)); // aligned
+  ifs.seekg(0);
+  if (length < sizeof(SnapshotHeader) ||
+      !ifs.read((char *)words.data(), length)) {
+    return false;
+  }
+  void *file = words.data();
+#endif
+  const SnapshotHeader *header = (const SnapshotHeader *)file;
+  const SnapshotElem *elems = (const SnapshotElem *)(header + 1);
+  const int *policy = (const int *)(elems + max(header->count, 0));
+  const int *engine = policy + max(header->policyWords, 0);
+  int capacity = rp->getCapacity();
+  bool ok = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+            header->version == SNAPSHOT_VERSION &&
+            header->maxSize == capacity && header->count >= 0 &&
+            header->count <= capacity && header->policyWords >= 0 &&
+            header->engineWords >= 0 &&
+            (size_t)((const char *)(engine + header->engineWords) -
+                     (const char *)file) == length;
+  vector<bool> seen(capacity, false); // two entries in one slot leak one
+  for (int i = 0; ok && i < header->count; i++) {
+    ok = elems[i].idx >= 0 && elems[i].idx < capacity &&
+         !seen[elems[i].idx] && elems[i].type >= INT_DATA &&
+         elems[i].type <= ADDRESS_DATA;
+    if (ok) {
+      seen[elems[i].idx] = true;
+    }
+  }
+  if (ok) {
+    vector<Elem *> inserted;
+    vector<int> idx;
+    for (int i = 0; i < header->count; i++) {
+      inserted.push_back(
+          new Elem(elems[i].addr,
+                   makeData((DataType)elems[i].type, elems[i].bits),
+                   elems[i].sync != 0));
+      idx.push_back(elems[i].idx);
+      rp->setValue(elems[i].idx, inserted.back());
+    }
+    ok = rp->load(policy, header->policyWords);
+    if (ok && rp->getCount() != header->count) {
+      while (rp->evict() >= 0) { // back to empty before the entries go
+      }
+      ok = false;
+    }
+    if (!ok) {
+      for (int i = 0; i < header->count; i++) {
+        rp->setValue(idx[i], nullptr);
+        delete inserted[i];
+      }
+    } else if (!s_engine->load(engine, header->engineWords, capacity)) {
+      s_engine->bulkInsert(inserted.data(), idx.data(), header->count);
+    }
+  }
+#ifdef HAVE_MMAP
+  munmap(file, length);
+#endif
+  return ok;
+}
@@ -2,13 +2,110 @@
 #define CACHE_H
 
 #include "main.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <vector>
+// runtime avx2 dispatch needs the GCC/Clang target attribute
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_AVX2_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+// a hint to pull the cache line at p in for reading, a no-op elsewhere
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#define PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
+
+const int PREFETCH_GROUP = 16; // lookups kept in flight by the batch paths
+
+// Exact ((x % d) + d) % d without a division: Lemire, Kaser and Kurz,
+// "Faster Remainder by Direct Computation". m must be fastmodInit(d).
+inline uint64_t fastmodInit(int d) { return UINT64_MAX / (uint32_t)d + 1; }
+inline uint64_t mulhi64(uint64_t a, uint32_t b) { // (a * b) >> 64
+#ifdef __SIZEOF_INT128__
+  return (uint64_t)(((__uint128_t)a * b) >> 64);
+#else
+  return ((a >> 32) * b + (((a & 0xffffffffu) * b) >> 32)) >> 32;
+#endif
+}
+inline int fastmod(int x, uint64_t m, int d) {
+  uint32_t a = (x >= 0) ? (uint32_t)x : 0u - (uint32_t)x;
+  uint32_t r = (uint32_t)mulhi64(m * a, (uint32_t)d);
+  return (x >= 0 || r == 0) ? (int)r : d - (int)r;
+}
+
+// out[i] = x[i] mod d for the first probe of a batch of keys
+inline void modBatchScalar(const int *x, int n, int d, uint64_t m, int *out) {
+  for (int i = 0; i < n; i++) {
+    out[i] = fastmod(x[i], m, d);
+  }
+}
+
+#ifdef HAVE_AVX2_DISPATCH
+// 8 lanes per step: q = floor(x / d) through doubles is off by at most one,
+// and the two masked corrections below bring r back into [0, d)
+__attribute__((target("avx2"))) inline void
+modBatchAVX2(const int *x, int n, int d, uint64_t m, int *out) {
+  __m256d inv = _mm256_set1_pd(1.0 / d);
+  __m256i vd = _mm256_set1_epi32(d), zero = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+    __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+    __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+    __m128i qlo = _mm256_cvttpd_epi32(_mm256_floor_pd(_mm256_mul_pd(lo, inv)));
+    __m128i qhi = _mm256_cvttpd_epi32(_mm256_floor_pd(_mm256_mul_pd(hi, inv)));
+    __m256i q = _mm256_set_m128i(qhi, qlo);
+    __m256i r = _mm256_sub_epi32(v, _mm256_mullo_epi32(q, vd));
+    r = _mm256_add_epi32(r, _mm256_and_si256(_mm256_cmpgt_epi32(zero, r), vd));
+    r = _mm256_sub_epi32(r, _mm256_andnot_si256(_mm256_cmpgt_epi32(vd, r), vd));
+    _mm256_storeu_si256((__m256i *)(out + i), r);
+  }
+  modBatchScalar(x + i, n - i, d, m, out + i);
+}
+#endif
+
+typedef void (*ModBatch)(const int *, int, int, uint64_t, int *);
+
+int nextPrime(int n) {
+  for (;; n++) {
+    bool prime = n > 1;
+    for (int d = 2; prime && (long long)d * d <= n; d++) {
+      prime = n % d != 0;
+    }
+    if (prime) {
+      return n;
+    }
+  }
+}
+
+inline ModBatch selectModBatch(int d) {
+#ifdef HAVE_AVX2_DISPATCH
+  // the lane corrections need 2 * d to fit in an int
+  if (d < (1 << 30) && __builtin_cpu_supports("avx2")) {
+    return modBatchAVX2;
+  }
+#endif
+  return modBatchScalar;
+}
 
 class ReplacementPolicy {
 protected:
   int count;
+  int capacity;
   Elem **arr;
+  bool dynamic;          // slots are taken and released, see setDynamic
+  vector<int> freeSlots; // dynamic only, lowest index last
 
 public:
+  ReplacementPolicy(int capacity) : capacity(capacity), dynamic(false) {}
   virtual ~ReplacementPolicy() {}
   virtual int insert(Elem *e,
                      int idx) = 0; // insert e into arr[idx] if idx != -1 else
@@ -16,12 +113,86 @@ public:
   virtual void
   access(int idx) = 0; // idx is index in the cache of the accessed element
   virtual int remove() = 0;
-  virtual void print() = 0;
+  virtual int evict() = 0;  // remove() even if not full, -1 if empty
+  virtual int victim() = 0; // what evict() would return, without removing
+  // Dynamic mode only: evict() that passes over slot keep, -1 if keep is
+  // the only entry; and taking slot idx out of the order wherever it is.
+  virtual int evictExcept(int keep) = 0;
+  virtual void erase(int idx) = 0;
+  virtual void relocate(int from, int to) = 0; // entry at from moved to to
+  virtual void print(ostream &os) = 0;
+  virtual void dump(vector<int> &out) = 0; // replacement order, for snapshots
+  virtual bool load(const int *in, int n) = 0; // inverse of dump
+
+protected:
+  // true if the n slots at in[0], in[stride], ... are distinct and are
+  // exactly the slots that hold entries, as a dump lists them
+  bool validSlots(const int *in, int n, int stride) {
+    int used = 0;
+    for (int i = 0; i < capacity; i++) {
+      used += arr[i] != nullptr;
+    }
+    if (n != used) {
+      return false;
+    }
+    vector<bool> seen(capacity, false);
+    for (int i = 0; i < n; i++) {
+      int idx = in[i * stride];
+      if (idx < 0 || idx >= capacity || seen[idx] || arr[idx] == nullptr) {
+        return false;
+      }
+      seen[idx] = true;
+    }
+    return true;
+  }
 
-  bool isFull() { return count == MAXSIZE; }
+public:
+  bool isFull() { return !dynamic && count == capacity; }
   bool isEmpty() { return count == 0; }
+  int getCount() { return count; }
   Elem *getValue(int idx) {
-    return (idx >= 0 && idx < MAXSIZE) ? arr[idx] : nullptr;
+    return (idx >= 0 && idx < capacity) ? arr[idx] : nullptr;
+  }
+  int getCapacity() { return capacity; }
+  void setValue(int idx, Elem *e) { arr[idx] = e; } // no reordering
+
+  // Dynamic mode, for caches that are not bounded by a slot count: the
+  // policy is never full, the owner evicts with evict() and places entries
+  // in slots from takeSlot(), and the slot array grows and shrinks.
+  void setDynamic() { // only while empty
+    dynamic = true;
+    resize(capacity);
+  }
+  bool isDynamic() { return dynamic; }
+  int takeSlot() {
+    if (freeSlots.empty()) {
+      resize(max(2 * capacity, 16));
+    }
+    int idx = freeSlots.back();
+    freeSlots.pop_back();
+    return idx;
+  }
+  void releaseSlot(int idx) { // after evict() or moveSlot()
+    arr[idx] = nullptr;
+    freeSlots.push_back(idx);
+  }
+  void moveSlot(int from, int to) {
+    arr[to] = arr[from];
+    arr[from] = nullptr;
+    relocate(from, to);
+  }
+  virtual void resize(int n) { // n >= every used slot index + 1
+    Elem **larger = new Elem *[n]();
+    copy(arr, arr + min(n, capacity), larger);
+    delete[] arr;
+    arr = larger;
+    capacity = n;
+    freeSlots.clear();
+    for (int i = n - 1; i >= 0; i--) {
+      if (arr[i] == nullptr) {
+        freeSlots.push_back(i);
+      }
+    }
   }
 };
 
@@ -31,21 +202,61 @@ public:
   virtual int search(int key) = 0; // -1 if not found
   virtual void insert(Elem *e, int idx) = 0;
   virtual void deleteNode(Elem *e) = 0;
-  virtual void print(ReplacementPolicy *r) = 0;
+  virtual void print(ReplacementPolicy *r, ostream &os) = 0;
+  virtual void bulkInsert(Elem **e, int *idx, int n) { // e[i] goes to idx[i]
+    for (int i = 0; i < n; i++) {
+      insert(e[i], idx[i]);
+    }
+  }
+  virtual void searchBatch(const int *key, int n, int *idx) {
+    for (int i = 0; i < n; i++) {
+      idx[i] = search(key[i]);
+    }
+  }
+  virtual void prefetch(int /*key*/) {} // hint ahead of a search or insert
+  // search() that also leaves a hint for replace(), -1 if it has none
+  virtual int searchHint(int key, int &hint) {
+    hint = -1;
+    return search(key);
+  }
+  // deleteNode(victim) followed by insert(e, idx)
+  virtual void replace(Elem *victim, Elem *e, int idx, int /*hint*/) {
+    deleteNode(victim);
+    insert(e, idx);
+  }
+  virtual void dump(vector<int> & /*out*/) {} // layout for snapshots
+  // inverse of dump; every idx must be below capacity
+  virtual bool load(const int * /*in*/, int /*n*/, int /*capacity*/) {
+    return false;
+  }
+  virtual void diagnose(EngineStats & /*out*/) {} // fills what the engine has
+  virtual void relocate(Elem *e, int idx) { // e now lives in slot idx
+    deleteNode(e);
+    insert(e, idx);
+  }
+  // lets the engine grow once more than maxLoad of it is used, moving
+  // step of its old slots per operation; false if it cannot grow
+  virtual bool setGrowth(double /*maxLoad*/, int /*step*/) { return false; }
+  // appends the slots of the keys in [lo, hi] in key order; false if the
+  // engine keeps no order
+  virtual bool scan(int /*lo*/, int /*hi*/, vector<int> & /*idx*/) {
+    return false;
+  }
 };
 
-class FIFO : public ReplacementPolicy {
+class FIFO final : public ReplacementPolicy {
 private:
   int head;
+  deque<int> order; // dynamic mode: slots oldest first
 
 public:
-  FIFO() {
-    arr = new Elem *[MAXSIZE]();
+  FIFO(int capacity = MAXSIZE) : ReplacementPolicy(capacity) {
+    arr = new Elem *[capacity]();
     count = head = 0;
   }
   ~FIFO() {
     for (int i = 0; i < count; i++) {
-      delete arr[(head + i) % count];
+      delete arr[dynamic ? order[i] : (head + i) % count];
     }
     delete[] arr;
   }
@@ -53,33 +264,94 @@ public:
     idx = (idx == -1) ? count : idx;
     count++;
     arr[idx] = e;
+    if (dynamic) {
+      order.push_back(idx);
+    }
     return idx;
   }
   void access(int idx) {
-    if (idx < 0 || idx >= MAXSIZE) {
+    if (idx < 0 || idx >= capacity) {
       return;
     }
     if (!arr[idx]) {
       return;
     }
   }
+  int victim() {
+    if (count == 0) {
+      return -1;
+    }
+    return dynamic ? order.front() : head;
+  }
   int remove() {
     if (!isFull()) {
       return -1;
     }
+    return evict();
+  }
+  int evict() {
+    if (count == 0) {
+      return -1;
+    }
+    count--;
+    if (dynamic) {
+      int idx = order.front();
+      order.pop_front();
+      return idx;
+    }
     int idx = head++;
-    head = head % MAXSIZE;
+    head = head % capacity;
+    return idx;
+  }
+  int evictExcept(int keep) {
+    if (victim() != keep) {
+      return evict();
+    }
+    if (!dynamic || count < 2) {
+      return -1;
+    }
+    int idx = order[1];
+    order.erase(order.begin() + 1);
     count--;
     return idx;
   }
-  void print() {
+  void erase(int idx) {
+    deque<int>::iterator it = find(order.begin(), order.end(), idx);
+    if (it != order.end()) {
+      order.erase(it);
+      count--;
+    }
+  }
+  void relocate(int from, int to) {
+    replace(order.begin(), order.end(), from, to);
+  }
+  void print(ostream &os) {
     for (int i = 0; i < count; i++) {
-      arr[(head + i) % count]->print();
+      arr[dynamic ? order[i] : (head + i) % count]->print(os);
+    }
+  }
+  void dump(vector<int> &out) {
+    out.push_back(3);
+    out.push_back(count);
+    out.push_back(head);
+  }
+  bool load(const int *in, int n) {
+    if (n != 3 || in[0] != 3 || in[1] < 0 || in[1] > capacity ||
+        in[2] < 0 || in[2] >= max(capacity, 1)) {
+      return false;
+    }
+    for (int i = 0; i < capacity; i++) {
+      if ((arr[i] != nullptr) != (i < in[1])) {
+        return false; // the entries fill slots 0 to count - 1
+      }
     }
+    count = in[1];
+    head = in[2];
+    return true;
   }
 };
 
-class MRU : public ReplacementPolicy {
+class MRU final : public ReplacementPolicy {
 private:
   struct Node {
     int idx;
@@ -89,9 +361,26 @@ private:
         : idx(idx), next(next), prev(prev) {}
   } * head, *tail;
 
+  int unlinkNode(Node *temp) { // frees temp, returns its slot
+    (temp->prev ? temp->prev->next : head) = temp->next;
+    (temp->next ? temp->next->prev : tail) = temp->prev;
+    int idx = temp->idx;
+    delete temp;
+    count--;
+    return idx;
+  }
+  void eraseNode(int idx) {
+    for (Node *temp = head; temp; temp = temp->next) {
+      if (temp->idx == idx) {
+        unlinkNode(temp);
+        break;
+      }
+    }
+  }
+
 public:
-  MRU() {
-    arr = new Elem *[MAXSIZE]();
+  MRU(int capacity = MAXSIZE) : ReplacementPolicy(capacity) {
+    arr = new Elem *[capacity]();
     count = 0;
     head = tail = nullptr;
   }
@@ -117,7 +406,7 @@ public:
     return idx;
   }
   void access(int idx) {
-    if (idx < 0 || idx >= MAXSIZE) {
+    if (idx < 0 || idx >= capacity) {
       return;
     }
     Node *temp = head;
@@ -139,10 +428,25 @@ public:
       }
     }
   }
+  int victim() { return (count > 0) ? head->idx : -1; }
   int remove() {
     if (!isFull()) {
       return -1;
     }
+    return evict();
+  }
+  void relocate(int from, int to) {
+    for (Node *temp = head; temp; temp = temp->next) {
+      if (temp->idx == from) {
+        temp->idx = to;
+        break;
+      }
+    }
+  }
+  int evict() {
+    if (count == 0) {
+      return -1;
+    }
     Node *temp = head;
     head = temp->next;
     if (temp == tail) {
@@ -155,15 +459,44 @@ public:
     count--;
     return idx;
   }
-  void print() {
+  int evictExcept(int keep) {
+    Node *temp = (head != nullptr && head->idx == keep) ? head->next : head;
+    return (temp != nullptr) ? unlinkNode(temp) : -1;
+  }
+  void erase(int idx) { eraseNode(idx); }
+  void print(ostream &os) {
     Node *temp = head;
     for (int i = 0; i < count; temp = temp->next, i++) {
-      arr[temp->idx]->print();
+      arr[temp->idx]->print(os);
+    }
+  }
+  void dump(vector<int> &out) {
+    out.push_back(4);
+    out.push_back(count);
+    for (Node *temp = head; temp; temp = temp->next) {
+      out.push_back(temp->idx);
+    }
+  }
+  bool load(const int *in, int n) {
+    if (n < 2 || in[0] != 4 || in[1] < 0 || n != in[1] + 2 ||
+        !validSlots(in + 2, in[1], 1)) {
+      return false;
+    }
+    for (int i = 0; i < in[1]; i++) {
+      Node *node = new Node(in[i + 2], nullptr, tail);
+      if (tail) {
+        tail->next = node;
+      } else {
+        head = node;
+      }
+      tail = node;
     }
+    count = in[1];
+    return true;
   }
 };
 
-class LRU : public ReplacementPolicy {
+class LRU final : public ReplacementPolicy {
 private:
   struct Node {
     int idx;
@@ -173,9 +506,26 @@ private:
         : idx(idx), next(next), prev(prev) {}
   } * head, *tail;
 
+  int unlinkNode(Node *temp) { // frees temp, returns its slot
+    (temp->prev ? temp->prev->next : head) = temp->next;
+    (temp->next ? temp->next->prev : tail) = temp->prev;
+    int idx = temp->idx;
+    delete temp;
+    count--;
+    return idx;
+  }
+  void eraseNode(int idx) {
+    for (Node *temp = head; temp; temp = temp->next) {
+      if (temp->idx == idx) {
+        unlinkNode(temp);
+        break;
+      }
+    }
+  }
+
 public:
-  LRU() {
-    arr = new Elem *[MAXSIZE]();
+  LRU(int capacity = MAXSIZE) : ReplacementPolicy(capacity) {
+    arr = new Elem *[capacity]();
     count = 0;
     head = tail = nullptr;
   }
@@ -201,7 +551,7 @@ public:
     return idx;
   }
   void access(int idx) {
-    if (idx < 0 || idx >= MAXSIZE) {
+    if (idx < 0 || idx >= capacity) {
       return;
     }
     Node *temp = head;
@@ -223,10 +573,25 @@ public:
       }
     }
   }
+  int victim() { return (count > 0) ? tail->idx : -1; }
   int remove() {
     if (!isFull()) {
       return -1;
     }
+    return evict();
+  }
+  void relocate(int from, int to) {
+    for (Node *temp = head; temp; temp = temp->next) {
+      if (temp->idx == from) {
+        temp->idx = to;
+        break;
+      }
+    }
+  }
+  int evict() {
+    if (count == 0) {
+      return -1;
+    }
     Node *temp = tail;
     tail = temp->prev;
     if (temp == head) {
@@ -239,15 +604,44 @@ public:
     count--;
     return idx;
   }
-  void print() {
+  int evictExcept(int keep) {
+    Node *temp = (tail != nullptr && tail->idx == keep) ? tail->prev : tail;
+    return (temp != nullptr) ? unlinkNode(temp) : -1;
+  }
+  void erase(int idx) { eraseNode(idx); }
+  void print(ostream &os) {
     Node *temp = head;
     for (int i = 0; i < count; temp = temp->next, i++) {
-      arr[temp->idx]->print();
+      arr[temp->idx]->print(os);
+    }
+  }
+  void dump(vector<int> &out) {
+    out.push_back(1);
+    out.push_back(count);
+    for (Node *temp = head; temp; temp = temp->next) {
+      out.push_back(temp->idx);
+    }
+  }
+  bool load(const int *in, int n) {
+    if (n < 2 || in[0] != 1 || in[1] < 0 || n != in[1] + 2 ||
+        !validSlots(in + 2, in[1], 1)) {
+      return false;
     }
+    for (int i = 0; i < in[1]; i++) {
+      Node *node = new Node(in[i + 2], nullptr, tail);
+      if (tail) {
+        tail->next = node;
+      } else {
+        head = node;
+      }
+      tail = node;
+    }
+    count = in[1];
+    return true;
   }
 };
 
-class LFU : public ReplacementPolicy {
+class LFU final : public ReplacementPolicy {
 private:
   struct Node {
     int idx, count;
@@ -271,6 +665,19 @@ private:
     }
   }
 
+  // takes the node at heap position i out, as evict does the root
+  int removeAt(int i) {
+    int idx = head[i]->idx;
+    delete head[i];
+    if (--count > i) {
+      head[i] = head[count];
+      heapDown(i);
+      heapUp(i);
+    }
+    head[count] = nullptr;
+    return idx;
+  }
+
   void heapUp(int child) {
     if (child > 0) {
       int parent = (child - 1) / 2;
@@ -285,10 +692,10 @@ private:
   }
 
 public:
-  LFU() {
-    arr = new Elem *[MAXSIZE]();
+  LFU(int capacity = MAXSIZE) : ReplacementPolicy(capacity) {
+    arr = new Elem *[capacity]();
     count = 0;
-    head = new Node *[MAXSIZE]();
+    head = new Node *[capacity]();
   }
   ~LFU() {
     for (int i = 0; i < count; i++) {
@@ -306,7 +713,7 @@ public:
     return idx;
   }
   void access(int idx) {
-    if (idx < 0 || idx >= MAXSIZE) {
+    if (idx < 0 || idx >= capacity) {
       return;
     }
     for (int i = 0; i < count; i++) {
@@ -317,10 +724,32 @@ public:
       }
     }
   }
+  int victim() { return (count > 0) ? head[0]->idx : -1; }
   int remove() {
     if (!isFull()) {
       return -1;
     }
+    return evict();
+  }
+  void relocate(int from, int to) {
+    for (int i = 0; i < count; i++) {
+      if (head[i]->idx == from) {
+        head[i]->idx = to;
+        break;
+      }
+    }
+  }
+  void resize(int n) {
+    Node **larger = new Node *[n]();
+    copy(head, head + count, larger);
+    delete[] head;
+    head = larger;
+    ReplacementPolicy::resize(n);
+  }
+  int evict() {
+    if (count == 0) {
+      return -1;
+    }
     int idx = head[0]->idx;
     delete head[0];
     if (--count > 0) {
@@ -330,83 +759,521 @@ public:
     head[count] = nullptr;
     return idx;
   }
-  void print() {
+  int evictExcept(int keep) {
+    if (count == 0 || (count == 1 && head[0]->idx == keep)) {
+      return -1;
+    }
+    if (head[0]->idx != keep) {
+      return removeAt(0);
+    }
+    // the next candidate is the lesser child of the root
+    return removeAt((count > 2 && head[2]->count < head[1]->count) ? 2 : 1);
+  }
+  void erase(int idx) {
+    for (int i = 0; i < count; i++) {
+      if (head[i]->idx == idx) {
+        removeAt(i);
+        break;
+      }
+    }
+  }
+  void print(ostream &os) {
     for (int i = 0; i < count; i++)
-      arr[head[i]->idx]->print();
+      arr[head[i]->idx]->print(os);
+  }
+  void dump(vector<int> &out) {
+    out.push_back(2);
+    out.push_back(count);
+    for (int i = 0; i < count; i++) {
+      out.push_back(head[i]->idx);
+      out.push_back(head[i]->count);
+    }
+  }
+  bool load(const int *in, int n) {
+    if (n < 2 || in[0] != 2 || in[1] < 0 || n != in[1] * 2LL + 2 ||
+        !validSlots(in + 2, in[1], 2)) {
+      return false;
+    }
+    for (int i = 0; i < in[1]; i++) {
+      head[i] = new Node(in[i * 2 + 2], in[i * 2 + 3]);
+    }
+    count = in[1];
+    return true;
   }
 };
 
-class DBHashing : public SearchEngine {
+int h1(int k) { return k + 1; }
+int h2(int k) { return 2 * k + 1; }
+int h3(int k) { return 3 * k; }
+int h4(int k) { return 3 * k + 5; }
+
+// the digits of the S command for a pair of h1..h4, e.g. 12; 0 for any
+// other functions
+int hashPairId(int (*hash1)(int), int (*hash2)(int)) {
+  int (*const known[])(int) = {h1, h2, h3, h4};
+  int id1 = 0, id2 = 0;
+  for (int i = 0; i < 4; i++) {
+    id1 = (hash1 == known[i]) ? i + 1 : id1;
+    id2 = (hash2 == known[i]) ? i + 1 : id2;
+  }
+  return (id1 > 0 && id2 > 0) ? id1 * 10 + id2 : 0;
+}
+
+// Hash functions chosen at run time and called through pointers
+struct PtrHash {
+  int (*hash1)(int);
+  int (*hash2)(int);
+  PtrHash(int (*hash1)(int), int (*hash2)(int)) : hash1(hash1), hash2(hash2) {}
+  int h1(int k) { return hash1(k); }
+  int h2(int k) { return hash2(k); }
+  int id() { return hashPairId(hash1, hash2); }
+};
+
+// Hash functions fixed at compile time, inlined into every probe
+template <int (*H1)(int), int (*H2)(int)> struct FixedHash {
+  int h1(int k) { return H1(k); }
+  int h2(int k) { return H2(k); }
+  int id() { return hashPairId(H1, H2); }
+};
+
+// Double hashing over Hash::h1/h2. SIZE > 0 fixes the table size at compile
+// time so the modulo becomes a constant; otherwise a power-of-two size is
+// reduced with a mask and any other size with fastmod.
+//
+// With setGrowth a table that passes its load limit is replaced by one of
+// about twice the size. The old table stays in use and is drained a few
+// slots per insert and delete, so no single operation pays for the whole
+// rehash; until it is empty, lookups that miss the new table probe it.
+template <class Hash, int SIZE = 0>
+class HashEngine final : public SearchEngine {
 private:
   struct Node {
     int address, idx;
     Node(int address, int idx) : address(address), idx(idx) {}
   } * *head;
 
-  int (*hash1)(int);
-  int (*hash2)(int);
+  Hash hash;
   int size;
+  vector<bool> emptied;   // slot freed by a delete and not reused since
+  uint64_t failedInserts; // no free slot on the probe sequence
+  int mask;          // size - 1 if size is a power of two, else -1
+  uint64_t sizeInv;  // fastmodInit(size)
+  ModBatch modBatch; // picked once for this cpu and size
+  int live;          // entries in head and old
+  double maxLoad;    // grow past this load factor, 0: never
+  int step;          // old slots drained per operation, 0: all at once
+  // the table being drained into head while growing, nullptr otherwise
+  Node **old;
+  int oldSize, oldMask, drained; // drained: old slots already moved
+  uint64_t oldInv;
+
+  int reduce(int x) {
+    if (SIZE > 0) {
+      return (x % SIZE + SIZE) % SIZE;
+    }
+    if (mask >= 0) {
+      return x & mask;
+    }
+    return fastmod(x, sizeInv, size);
+  }
+
+  void reduceBatch(const int *x, int n, int *out) {
+    if (SIZE > 0 || mask >= 0) {
+      for (int i = 0; i < n; i++) {
+        out[i] = reduce(x[i]);
+      }
+    } else {
+      modBatch(x, n, size, sizeInv, out);
+    }
+  }
+
+  // A growing table steps by 1 where k2 would stay on the first slot, so
+  // on the prime sizes grow() picks every key reaches every slot. Only
+  // such keys move, and they could be nowhere but the first slot before.
+  int probe(int k1, int k2, int i) {
+    if (i > 0 && maxLoad > 0 && reduce(k2) == 0) {
+      k2 = 1;
+    }
+    return reduce(k1 + i * k2);
+  }
+  int oldReduce(int x) {
+    return (oldMask >= 0) ? x & oldMask : fastmod(x, oldInv, oldSize);
+  }
+  int oldProbe(int k1, int k2, int i) {
+    if (i > 0 && oldReduce(k2) == 0) {
+      k2 = 1;
+    }
+    return oldReduce(k1 + i * k2);
+  }
+  // slot of address in old, -1 if it is not there
+  int findOld(int address) {
+    int k1 = hash.h1(address), k2 = hash.h2(address);
+    for (int i = 0; old != nullptr && i < oldSize; i++) {
+      int temp = oldProbe(k1, k2, i);
+      if (old[temp] != nullptr && old[temp]->address == address) {
+        return temp;
+      }
+    }
+    return -1;
+  }
+  bool full() { return maxLoad > 0 && live + 1 > maxLoad * size; }
+  // retires head to old and starts an empty table about twice its size
+  void grow() {
+    drain(oldSize);
+    old = head;
+    oldSize = size;
+    oldMask = mask;
+    oldInv = sizeInv;
+    drained = 0;
+    uint64_t failed = failedInserts;
+    init(nextPrime(2 * size + 1));
+    failedInserts = failed;
+    drain((step > 0) ? 0 : oldSize);
+  }
+  // moves up to n more slots of old into head; head is prime-sized and
+  // holds fewer than live entries, so each node finds a free slot
+  void drain(int n) {
+    for (; old != nullptr && n > 0 && drained < oldSize; n--, drained++) {
+      Node *node = old[drained];
+      if (node == nullptr) {
+        continue;
+      }
+      old[drained] = nullptr;
+      int k1 = hash.h1(node->address), k2 = hash.h2(node->address);
+      for (int i = 0; i < size; i++) {
+        int temp = probe(k1, k2, i);
+        if (head[temp] == nullptr) {
+          head[temp] = node;
+          emptied[temp] = false;
+          break;
+        }
+      }
+    }
+    if (old != nullptr && drained == oldSize) {
+      delete[] old;
+      old = nullptr;
+    }
+  }
+
+  int hashAt(int address, int i) {
+    return probe(hash.h1(address), hash.h2(address), i);
+  }
+
+  void init(int size) {
+    this->size = (SIZE > 0) ? SIZE : size;
+    mask = ((this->size & (this->size - 1)) == 0) ? this->size - 1 : -1;
+    sizeInv = fastmodInit(this->size);
+    modBatch = selectModBatch(this->size);
+    head = new Node *[this->size]();
+    emptied.assign(this->size, false);
+    failedInserts = 0;
+  }
 
-  int hash(int address, int i) {
-    int k1 = hash1(address);
-    int k2 = hash2(address);
-    return ((k1 + i * k2) % size + size) % size;
+  void place(int slot, int address, int idx) {
+    head[slot] = new Node(address, idx);
+    emptied[slot] = false;
+    live++;
+  }
+  void erase(int slot) {
+    delete head[slot];
+    head[slot] = nullptr;
+    emptied[slot] = true;
+    live--;
   }
 
 public:
-  DBHashing(int (*hash1)(int), int (*hash2)(int), int size)
-      : hash1(hash1), hash2(hash2) {
-    head = new Node *[(this->size = size)]();
+  HashEngine(int (*hash1)(int), int (*hash2)(int), int size)
+      : hash(hash1, hash2), live(0), maxLoad(0), step(0), old(nullptr),
+        oldSize(0), oldMask(-1), drained(0), oldInv(0) {
+    init(size);
+  }
+  HashEngine(int size = SIZE)
+      : live(0), maxLoad(0), step(0), old(nullptr), oldSize(0), oldMask(-1),
+        drained(0), oldInv(0) {
+    init(size);
   }
-  ~DBHashing() {
+  ~HashEngine() {
     for (int i = 0; i < size; i++)
       if (head[i] != nullptr) {
         delete head[i];
       }
     delete[] head;
+    for (int i = drained; old != nullptr && i < oldSize; i++) {
+      delete old[i];
+    }
+    delete[] old;
+  }
+  bool setGrowth(double maxLoad, int step) {
+    if (SIZE > 0 || maxLoad <= 0 || maxLoad > 1) {
+      return false; // a compile-time size cannot change
+    }
+    this->maxLoad = maxLoad;
+    this->step = max(step, 0);
+    return true;
   }
   void insert(Elem *e, int idx) {
+    if (full()) {
+      grow();
+    }
+    drain(step);
     for (int i = 0; i < size; i++) {
-      int temp = hash(e->addr, i);
+      int temp = hashAt(e->addr, i);
       if (head[temp] == nullptr) {
-        head[temp] = new Node(e->addr, idx);
-        break;
+        place(temp, e->addr, idx);
+        return;
       }
     }
+    if (maxLoad > 0) { // a size given by the user may leave no slot
+      grow();
+      insert(e, idx);
+      return;
+    }
+    failedInserts++;
+  }
+  void bulkInsert(Elem **e, int *idx, int n) {
+    if (maxLoad > 0) {
+      SearchEngine::bulkInsert(e, idx, n); // may grow between inserts
+      return;
+    }
+    // same slots as n single inserts, but each key is hashed only once
+    for (int j = 0; j < n; j++) {
+      int k1 = hash.h1(e[j]->addr);
+      int k2 = hash.h2(e[j]->addr), i = 0;
+      for (; i < size; i++) {
+        int temp = probe(k1, k2, i);
+        if (head[temp] == nullptr) {
+          place(temp, e[j]->addr, idx[j]);
+          break;
+        }
+      }
+      failedInserts += i == size;
+    }
   }
   void deleteNode(Elem *e) {
     if (e == nullptr) {
       return;
     }
+    drain(step);
     for (int i = 0; i < size; i++) {
-      int temp = hash(e->addr, i);
+      int temp = hashAt(e->addr, i);
       if (head[temp] != nullptr && head[temp]->address == e->addr) {
-        delete head[temp];
-        head[temp] = nullptr;
-        break;
+        erase(temp);
+        return;
       }
     }
+    int slot = findOld(e->addr);
+    if (slot >= 0) {
+      delete old[slot];
+      old[slot] = nullptr;
+      live--;
+    }
   }
-  void print(ReplacementPolicy *q) {
-    cout << "Prime memory:" << endl;
+  void print(ReplacementPolicy *q, ostream &os) {
+    os << "Prime memory:" << endl;
     for (int i = 0; i < size; i++) {
       if (head[i] != nullptr)
-        q->getValue(head[i]->idx)->print();
+        q->getValue(head[i]->idx)->print(os);
+    }
+    for (int i = drained; old != nullptr && i < oldSize; i++) {
+      if (old[i] != nullptr)
+        q->getValue(old[i]->idx)->print(os);
     }
   }
+  void dump(vector<int> &out) {
+    drain(oldSize); // the layout is of one table
+    out.push_back(1);
+    out.push_back(size);
+    out.push_back(hash.id());
+    for (int i = 0; i < size; i++) {
+      if (head[i] != nullptr) {
+        out.push_back(i);
+        out.push_back(head[i]->address);
+        out.push_back(head[i]->idx);
+      }
+    }
+  }
+  // only into an empty table with the same size and hash functions
+  bool load(const int *in, int n, int capacity) {
+    drain(oldSize);
+    if (n < 3 || in[0] != 1 || in[1] != size || in[2] != hash.id() ||
+        in[2] == 0 || (n - 3) % 3 != 0 || live > 0) {
+      return false;
+    }
+    vector<bool> taken(size, false);
+    for (int i = 3; i < n; i += 3) {
+      if (in[i] < 0 || in[i] >= size || taken[in[i]] || in[i + 2] < 0 ||
+          in[i + 2] >= capacity) {
+        return false;
+      }
+      taken[in[i]] = true;
+    }
+    for (int i = 3; i < n; i += 3) {
+      place(in[i], in[i + 1], in[i + 2]);
+    }
+    return true;
+  }
   int search(int address) {
     int idx = -1;
     for (int i = 0; i < size; i++) {
-      int temp = hash(address, i);
+      int temp = hashAt(address, i);
       if (head[temp] != nullptr && head[temp]->address == address) {
         idx = head[temp]->idx;
         break;
       }
     }
+    if (idx < 0 && old != nullptr) {
+      int slot = findOld(address);
+      idx = (slot >= 0) ? old[slot]->idx : -1;
+    }
     return idx;
   }
+  void searchBatch(const int *key, int n, int *idx) {
+    if (old != nullptr) {
+      SearchEngine::searchBatch(key, n, idx);
+      return;
+    }
+    int k1[PREFETCH_GROUP], k2[PREFETCH_GROUP], first[PREFETCH_GROUP];
+    for (int base = 0; base < n; base += PREFETCH_GROUP) {
+      int m = min(PREFETCH_GROUP, n - base);
+      // stage 1: hash the group and pull in the first probed slots
+      for (int j = 0; j < m; j++) {
+        k1[j] = hash.h1(key[base + j]);
+        k2[j] = hash.h2(key[base + j]);
+      }
+      reduceBatch(k1, m, first);
+      for (int j = 0; j < m; j++) {
+        PREFETCH(&head[first[j]]);
+      }
+      // stage 2: pull in the nodes those slots point to
+      for (int j = 0; j < m; j++) {
+        if (head[first[j]] != nullptr) {
+          PREFETCH(head[first[j]]);
+        }
+      }
+      // stage 3: finish each lookup exactly like search()
+      for (int j = 0; j < m; j++) {
+        idx[base + j] = -1;
+        for (int i = 0; i < size; i++) {
+          int temp = (i == 0) ? first[j] : probe(k1[j], k2[j], i);
+          if (head[temp] != nullptr && head[temp]->address == key[base + j]) {
+            idx[base + j] = head[temp]->idx;
+            break;
+          }
+        }
+      }
+    }
+  }
+  void prefetch(int key) { PREFETCH(&head[hashAt(key, 0)]); }
+  // hint is the probe number of the first empty slot on the key's path,
+  // size if there is none
+  int searchHint(int address, int &hint) {
+    if (old != nullptr || maxLoad > 0) {
+      hint = -1; // replace then takes the growing path
+      return search(address);
+    }
+    int k1 = hash.h1(address), k2 = hash.h2(address);
+    hint = size;
+    for (int i = 0; i < size; i++) {
+      int temp = probe(k1, k2, i);
+      if (head[temp] == nullptr) {
+        hint = min(hint, i);
+      } else if (head[temp]->address == address) {
+        return head[temp]->idx;
+      }
+    }
+    return -1;
+  }
+  void replace(Elem *victim, Elem *e, int idx, int hint) {
+    if (hint < 0) {
+      deleteNode(victim);
+      insert(e, idx);
+      return;
+    }
+    int freed = -1;
+    if (victim != nullptr) {
+      int v1 = hash.h1(victim->addr), v2 = hash.h2(victim->addr);
+      for (int i = 0; i < size; i++) {
+        int temp = probe(v1, v2, i);
+        if (head[temp] != nullptr && head[temp]->address == victim->addr) {
+          freed = temp;
+          break;
+        }
+      }
+    }
+    // insert() would take the victim's slot if it comes before the hint
+    int k1 = hash.h1(e->addr), k2 = hash.h2(e->addr);
+    int slot = (hint < size) ? probe(k1, k2, hint) : -1;
+    for (int i = 0; freed >= 0 && i < hint; i++) {
+      if (probe(k1, k2, i) == freed) {
+        slot = freed;
+        break;
+      }
+    }
+    if (slot >= 0 && slot == freed) {
+      head[slot]->address = e->addr;
+      head[slot]->idx = idx;
+      return;
+    }
+    if (freed >= 0) {
+      erase(freed);
+    }
+    if (slot >= 0) {
+      place(slot, e->addr, idx);
+    } else {
+      failedInserts++;
+    }
+  }
+  void relocate(Elem *e, int idx) {
+    int k1 = hash.h1(e->addr), k2 = hash.h2(e->addr);
+    for (int i = 0; i < size; i++) {
+      int temp = probe(k1, k2, i);
+      if (head[temp] != nullptr && head[temp]->address == e->addr) {
+        head[temp]->idx = idx;
+        return;
+      }
+    }
+    int slot = findOld(e->addr);
+    if (slot >= 0) {
+      old[slot]->idx = idx;
+    }
+  }
+  void diagnose(EngineStats &out) {
+    for (int i = drained; old != nullptr && i < oldSize; i++) {
+      out.entries += old[i] != nullptr; // not drained yet
+    }
+    out.slots = size;
+    out.missProbes = size; // search does not stop at an empty slot
+    out.failedInserts = failedInserts;
+    for (int i = 0; i < size; i++) {
+      if (head[i] == nullptr) {
+        out.tombstones += emptied[i];
+        continue;
+      }
+      out.entries++;
+      int k1 = hash.h1(head[i]->address), k2 = hash.h2(head[i]->address);
+      for (int p = 0; p < size; p++) {
+        int temp = probe(k1, k2, p);
+        if (head[temp] != nullptr && head[temp]->address == head[i]->address) {
+          // a shadowed duplicate is never found and is not counted
+          if (temp == i) {
+            if ((int)out.probeLengths.size() <= p) {
+              out.probeLengths.resize(p + 1);
+            }
+            out.probeLengths[p]++;
+          }
+          break;
+        }
+      }
+    }
+  }
 };
-class AVL : public SearchEngine {
+
+typedef HashEngine<PtrHash> DBHashing;
+
+template <int (*H1)(int), int (*H2)(int)>
+using StaticDBHashing = HashEngine<FixedHash<H1, H2>>;
+
+class AVL final : public SearchEngine {
 private:
   enum BFactor { LH = -1, EH = 0, RH = 1 };
   struct Node {
@@ -419,8 +1286,10 @@ private:
           right(nullptr) {}
     int getAddress() { return address; }
   } * root;
+  uint64_t leftRotations, rightRotations;
 
   void rotateRight(Node *&node) {
+    rightRotations++;
     Node *temp = node;
     node = node->left;
     temp->left = node->right;
@@ -428,6 +1297,7 @@ private:
   }
 
   void rotateLeft(Node *&node) {
+    leftRotations++;
     Node *temp = node;
     node = node->right;
     temp->right = node->left;
@@ -579,22 +1449,115 @@ private:
     }
   }
 
-  void preOrder(ReplacementPolicy *q, Node *node) {
+  void preOrder(ReplacementPolicy *q, Node *node, ostream &os) {
+    if (!node) {
+      return;
+    }
+    q->getValue(node->idx)->print(os);
+    preOrder(q, node->left, os);
+    preOrder(q, node->right, os);
+  }
+
+  void inOrder(ReplacementPolicy *q, Node *node, ostream &os) {
+    if (!node) {
+      return;
+    }
+    inOrder(q, node->left, os);
+    q->getValue(node->idx)->print(os);
+    inOrder(q, node->right, os);
+  }
+
+  void scan(Node *node, int lo, int hi, vector<int> &idx) {
+    if (!node) {
+      return;
+    }
+    if (lo < node->address) {
+      scan(node->left, lo, hi, idx);
+    }
+    if (lo <= node->address && node->address <= hi) {
+      idx.push_back(node->idx);
+    }
+    if (node->address < hi) {
+      scan(node->right, lo, hi, idx);
+    }
+  }
+
+  void flatten(Node *node, vector<Node *> &nodes) {
     if (!node) {
       return;
     }
-    q->getValue(node->idx)->print();
-    preOrder(q, node->left);
-    preOrder(q, node->right);
+    flatten(node->left, nodes);
+    nodes.push_back(node);
+    flatten(node->right, nodes);
+  }
+
+  // links sorted nodes[lo..hi] into a perfectly balanced subtree
+  Node *build(vector<Node *> &nodes, int lo, int hi, int &height) {
+    if (lo > hi) {
+      height = 0;
+      return nullptr;
+    }
+    int mid = lo + (hi - lo) / 2, lh, rh;
+    Node *node = nodes[mid];
+    node->left = build(nodes, lo, mid - 1, lh);
+    node->right = build(nodes, mid + 1, hi, rh);
+    node->balance = (lh < rh) ? RH : (lh > rh) ? LH : EH;
+    height = max(lh, rh) + 1;
+    return node;
   }
 
-  void inOrder(ReplacementPolicy *q, Node *node) {
+  // preorder, 4 ints per node: address, idx, balance, child flags
+  void dump(Node *node, vector<int> &out) {
     if (!node) {
       return;
     }
-    inOrder(q, node->left);
-    q->getValue(node->idx)->print();
-    inOrder(q, node->right);
+    out.push_back(node->address);
+    out.push_back(node->idx);
+    out.push_back(node->balance);
+    out.push_back((node->left ? 1 : 0) | (node->right ? 2 : 0));
+    dump(node->left, out);
+    dump(node->right, out);
+  }
+
+  struct Loader {
+    const int *in;
+    int n, pos, capacity;
+    bool ok; // false once a record cannot be part of a valid tree
+  };
+  // the subtree whose addresses lie in (lo, hi)
+  Node *load(Loader &l, long long lo, long long hi, int depth) {
+    if (l.pos + 4 > l.n || depth > 64) { // an AVL tree is never that high
+      l.ok = false;
+      return nullptr;
+    }
+    const int *rec = l.in + l.pos;
+    l.pos += 4;
+    if (rec[0] <= lo || rec[0] >= hi || rec[1] < 0 ||
+        rec[1] >= l.capacity || rec[2] < LH || rec[2] > RH) {
+      l.ok = false;
+      return nullptr;
+    }
+    Node *node = new Node(rec[0], rec[1]);
+    node->balance = (BFactor)rec[2];
+    if (rec[3] & 1) {
+      node->left = load(l, lo, rec[0], depth + 1);
+    }
+    if (l.ok && (rec[3] & 2)) {
+      node->right = load(l, rec[0], hi, depth + 1);
+    }
+    return node;
+  }
+
+  // height of the subtree; adds every node's depth to sum
+  int measure(Node *node, int depth, long long &sum, int &count) {
+    if (!node) {
+      return 0;
+    }
+    sum += depth;
+    count++;
+    int lh = measure(node->left, depth + 1, sum, count);
+    int rh = measure(node->right, depth + 1, sum, count);
+    return max(lh, rh) + 1;
   }
 
   void clear(Node *&node) {
@@ -612,23 +1575,349 @@ private:
   }
 
 public:
-  AVL() { root = nullptr; }
+  AVL() {
+    root = nullptr;
+    leftRotations = rightRotations = 0;
+  }
   ~AVL() { clear(root); }
   void insert(Elem *e, int idx) { insert(root, e->addr, idx); }
+  void bulkInsert(Elem **e, int *idx, int n) {
+    auto byAddress = [](Node *a, Node *b) { return a->address < b->address; };
+    vector<Node *> added, nodes;
+    for (int i = 0; i < n; i++) {
+      added.push_back(new Node(e[i]->addr, idx[i]));
+    }
+    stable_sort(added.begin(), added.end(), byAddress);
+    flatten(root, nodes);
+    vector<Node *> merged(nodes.size() + added.size());
+    merge(nodes.begin(), nodes.end(), added.begin(), added.end(),
+          merged.begin(), byAddress);
+    int height;
+    root = build(merged, 0, (int)merged.size() - 1, height);
+  }
   void deleteNode(Elem *e) {
     if (e != nullptr)
       remove(root, e->addr);
   }
-  void print(ReplacementPolicy *q) {
-    cout << "Print AVL in inorder:" << endl;
-    this->inOrder(q, root);
-    cout << "Print AVL in preorder:" << endl;
-    this->preOrder(q, root);
+  void print(ReplacementPolicy *q, ostream &os) {
+    os << "Print AVL in inorder:" << endl;
+    this->inOrder(q, root, os);
+    os << "Print AVL in preorder:" << endl;
+    this->preOrder(q, root, os);
   }
   int search(int address) {
     int idx = search(root, address);
     return idx;
   }
+  bool scan(int lo, int hi, vector<int> &idx) {
+    scan(root, lo, hi, idx);
+    return true;
+  }
+  void searchBatch(const int *key, int n, int *idx) {
+    Node *cur[PREFETCH_GROUP];
+    for (int base = 0; base < n; base += PREFETCH_GROUP) {
+      int m = min(PREFETCH_GROUP, n - base), active = m;
+      for (int j = 0; j < m; j++) {
+        cur[j] = root;
+        idx[base + j] = -1;
+      }
+      // descend all m paths one level per round so their misses overlap
+      while (active > 0) {
+        active = 0;
+        for (int j = 0; j < m; j++) {
+          Node *node = cur[j];
+          if (node == nullptr) {
+            continue;
+          }
+          if (node->address == key[base + j]) {
+            idx[base + j] = node->idx;
+            cur[j] = nullptr;
+            continue;
+          }
+          node = (key[base + j] < node->address) ? node->left : node->right;
+          if (node != nullptr) {
+            PREFETCH(node);
+            active++;
+          }
+          cur[j] = node;
+        }
+      }
+    }
+  }
+  void dump(vector<int> &out) {
+    out.push_back(0);
+    dump(root, out);
+  }
+  bool load(const int *in, int n, int capacity) {
+    if (n < 1 || in[0] != 0 || (n - 1) % 4 != 0 || root != nullptr) {
+      return false;
+    }
+    Loader l = {in, n, 1, capacity, true};
+    if (n > 1) {
+      root = load(l, (long long)INT_MIN - 1, (long long)INT_MAX + 1, 1);
+    }
+    if (!l.ok || l.pos != n) {
+      clear(root);
+      root = nullptr;
+      return false;
+    }
+    return true;
+  }
+  void relocate(Elem *e, int idx) {
+    Node *node = root;
+    while (node != nullptr && node->address != e->addr) {
+      node = (e->addr < node->address) ? node->left : node->right;
+    }
+    if (node != nullptr) {
+      node->idx = idx;
+    }
+  }
+  void diagnose(EngineStats &out) {
+    long long sum = 0;
+    out.height = measure(root, 1, sum, out.entries);
+    out.avgDepth = out.entries ? (double)sum / out.entries : 0;
+    out.leftRotations = leftRotations;
+    out.rightRotations = rightRotations;
+  }
 };
 
+template <class Engine, class Policy>
+Data *BasicCache<Engine, Policy>::read(int addr) {
+  uint64_t start = ticks();
+  if (mrc != nullptr) {
+    mrc->access(addr);
+  }
+  if (admission != nullptr) {
+    admission->record(addr);
+  }
+  int idx = s_engine->search(addr);
+  Elem *searched = rp->getValue(idx);
+  rp->access(idx);
+  counters.reads++;
+  counters.readHits += searched != nullptr;
+  Data *data = (searched != nullptr) ? searched->data : promote(addr);
+  missPending = data == nullptr;
+  missedAddr = addr;
+  counters.readLatency.record(ticks() - start);
+  return data;
+}
+
+// moves addr from the spill tier into the cache, nullptr if it is not there
+template <class Engine, class Policy>
+Data *BasicCache<Engine, Policy>::promote(int addr) {
+  bool sync;
+  Data *data = (spill != nullptr) ? spill->take(addr, sync) : nullptr;
+  if (data == nullptr) {
+    return nullptr;
+  }
+  counters.spillHits++;
+  Elem *victim = insert(addr, data, sync, (budget > 0) ? entrySize(data) : 0);
+  if (victim != nullptr && sink != nullptr) {
+    sink->push_back(victim);
+  } else {
+    delete victim;
+  }
+  return data;
+}
+
+template <class Engine, class Policy>
+void BasicCache<Engine, Policy>::evicted(Elem *victim) {
+  if (victim == nullptr) {
+    return;
+  }
+  counters.evictions++;
+  counters.dirtyEvictions += !victim->sync;
+  if (spill != nullptr) {
+    spill->store(victim->addr, victim->data, victim->sync);
+  }
+}
+
+template <class Engine, class Policy>
+bool BasicCache<Engine, Policy>::admits(int addr, size_t need) {
+  if (budget > 0 && need > budget) {
+    counters.rejected++; // larger than the whole cache
+    return false;
+  }
+  bool full = (budget > 0) ? used + need > budget : rp->isFull();
+  if (admission == nullptr || !full) {
+    return true;
+  }
+  bool admitted = admission->admit(addr, rp->getValue(rp->victim())->addr);
+  counters.rejected += !admitted;
+  return admitted;
+}
+
+template <class Engine, class Policy>
+Elem *BasicCache<Engine, Policy>::put(int addr, Data *cont) {
+  uint64_t start = ticks();
+  if (spill != nullptr) {
+    spill->erase(addr); // even if not admitted, a newer value was given
+  }
+  if (admission != nullptr && !(missPending && missedAddr == addr)) {
+    admission->record(addr);
+  }
+  missPending = false;
+  size_t need = (budget > 0) ? entrySize(cont) : 0;
+  if (!admits(addr, need)) {
+    delete cont;
+    counters.puts++;
+    counters.putLatency.record(ticks() - start);
+    return nullptr;
+  }
+  Elem *deleted = insert(addr, cont, true, need);
+  counters.puts++;
+  counters.putLatency.record(ticks() - start);
+  return deleted;
+}
+
+// adds a new entry, evicting for it; returns the first victim
+template <class Engine, class Policy>
+Elem *BasicCache<Engine, Policy>::insert(int addr, Data *cont, bool sync,
+                                         size_t need) {
+  int idx;
+  Elem *deleted;
+  if (budget > 0) {
+    deleted = makeRoom(need, -1);
+    idx = rp->takeSlot();
+    used += need;
+  } else {
+    idx = rp->remove();
+    deleted = rp->getValue(idx);
+    s_engine->deleteNode(deleted);
+    evicted(deleted);
+  }
+  Elem *inserted = new Elem(addr, cont, sync);
+  idx = rp->insert(inserted, idx);
+  s_engine->insert(inserted, idx);
+  return deleted;
+}
+
+template <class Engine, class Policy>
+Elem *BasicCache<Engine, Policy>::write(int addr, Data *cont) {
+  uint64_t start = ticks();
+  if (wal != nullptr) {
+    lsn = wal->append(addr, cont);
+  }
+  if (spill != nullptr) {
+    spill->erase(addr); // the write is newer, cached or not
+  }
+  if (admission != nullptr) {
+    admission->record(addr);
+  }
+  missPending = false;
+  int hint;
+  int idx = s_engine->searchHint(addr, hint);
+  Elem *searched = rp->getValue(idx);
+  Elem *deleted = nullptr;
+  size_t need = (budget > 0) ? entrySize(cont) : 0;
+  if (searched != nullptr && budget > 0 && need > budget) {
+    // larger than the whole cache: the write goes around it, and the
+    // cached value is out of date
+    counters.rejected++;
+    s_engine->deleteNode(searched);
+    rp->erase(idx);
+    rp->releaseSlot(idx);
+    used -= entrySize(searched->data);
+    delete searched;
+    delete cont;
+  } else if (searched != nullptr) {
+    rp->access(idx);
+    Data *data = searched->data;
+    searched->data = cont;
+    searched->sync = false;
+    if (budget > 0) {
+      used += need - entrySize(data);
+      deleted = makeRoom(0, idx); // the value may have grown
+    }
+    delete data;
+  } else if (!admits(addr, need)) {
+    delete cont; // not cached: the write goes around the cache
+  } else if (budget > 0) {
+    deleted = insert(addr, cont, false, need);
+  } else {
+    idx = rp->remove();
+    deleted = rp->getValue(idx);
+    Elem *inserted = new Elem(addr, cont, false);
+    idx = rp->insert(inserted, idx);
+    s_engine->replace(deleted, inserted, idx, hint);
+    evicted(deleted);
+  }
+  counters.writes++;
+  counters.writeHits += searched != nullptr;
+  counters.writeLatency.record(ticks() - start);
+  return deleted;
+}
+
+// Evicts until need more bytes fit, passing over the entry in slot keep,
+// which may be all that is left. Returns the first victim; later ones go
+// to the sink, or are freed without one.
+template <class Engine, class Policy>
+Elem *BasicCache<Engine, Policy>::makeRoom(size_t need, int keep) {
+  Elem *first = nullptr;
+  while (used + need > budget) {
+    int idx = rp->evictExcept(keep);
+    if (idx < 0) {
+      break;
+    }
+    Elem *victim = rp->getValue(idx);
+    s_engine->deleteNode(victim);
+    rp->releaseSlot(idx);
+    used -= entrySize(victim->data);
+    evicted(victim);
+    if (first == nullptr) {
+      first = victim;
+    } else if (sink != nullptr) {
+      sink->push_back(victim);
+    } else {
+      delete victim;
+    }
+  }
+  int capacity = rp->getCapacity();
+  if (capacity > 16 && rp->getCount() * 4 <= capacity) {
+    shrinkSlots(capacity / 2);
+  }
+  return first;
+}
+
+// moves the entries above slot n below it, then cuts the array to n
+template <class Engine, class Policy>
+void BasicCache<Engine, Policy>::shrinkSlots(int n) {
+  vector<int> holes;
+  for (int i = n - 1; i >= 0; i--) {
+    if (rp->getValue(i) == nullptr) {
+      holes.push_back(i);
+    }
+  }
+  for (int i = n; i < rp->getCapacity(); i++) {
+    Elem *e = rp->getValue(i);
+    if (e != nullptr) {
+      int to = holes.back();
+      holes.pop_back();
+      rp->moveSlot(i, to);
+      s_engine->relocate(e, to);
+    }
+  }
+  rp->resize(n);
+}
+
+// Snapshot file: header, count elems, policyWords ints of policy dump, then
+// engineWords ints of engine dump. Native byte order, 4-byte aligned so the
+// whole file can be read in place through mmap.
+struct SnapshotHeader {
+  char magic[8]; // "AVLSNAP"
+  int version;
+  int maxSize;
+  int count;
+  int policyWords;
+  int engineWords; // 0 if the search engine layout was not saved
+};
+
+struct SnapshotElem {
+  int idx, addr, bits;
+  char type, sync, pad[2];
+};
+
+const char SNAPSHOT_MAGIC[8] = "AVLSNAP";
+const int SNAPSHOT_VERSION = 2; // 2: hash ids in the DBHashing layout
+
 #endif
\ No newline at end of file
@@ -0,0 +1,119 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "Protocol.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct Reply {
+  char status; // REPLY_HIT, REPLY_MISS, REPLY_OK or REPLY_EVICTED
+  int addr;    // of the victim
+  bool sync;
+  Data *data;  // the value read or evicted, the caller's to delete
+};
+
+// Client of the cache server. read, put and write make one round trip
+// each. To pipeline, queue requests with send, push them out with flush
+// and collect the replies in order with receive.
+class CacheClient {
+  int fd;
+  string out, in;
+  size_t consumed; // bytes of in already handed out
+
+public:
+  CacheClient() : fd(-1), consumed(0) {}
+  ~CacheClient() { disconnect(); }
+  bool connect(const string &path) {
+    disconnect();
+    sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(sa.sun_path)) {
+      return false;
+    }
+    memcpy(sa.sun_path, path.c_str(), path.size());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && ::connect(fd, (sockaddr *)&sa, sizeof(sa)) != 0) {
+      disconnect();
+    }
+    return fd >= 0;
+  }
+  void disconnect() {
+    if (fd >= 0) {
+      close(fd);
+    }
+    fd = -1;
+    out.clear();
+    in.clear();
+    consumed = 0;
+  }
+  // queues a request; takes ownership of data, as Cache does
+  void send(char op, int addr, Data *data = nullptr) {
+    appendRequest(out, op, addr, data);
+    delete data;
+  }
+  bool flush() {
+    for (size_t off = 0; off < out.size();) {
+      ssize_t n = ::write(fd, out.data() + off, out.size() - off);
+      if (n <= 0) {
+        return false;
+      }
+      off += n;
+    }
+    out.clear();
+    return true;
+  }
+  // the reply to the oldest request not answered yet; false if the
+  // server has gone
+  bool receive(Reply &r) {
+    size_t size;
+    while ((size = messageSize<WireReply>(in.data() + consumed,
+                                          in.size() - consumed)) == 0) {
+      if (consumed > 0) {
+        in.erase(0, consumed);
+        consumed = 0;
+      }
+      char chunk[1 << 16];
+      ssize_t n = ::read(fd, chunk, sizeof(chunk));
+      if (n <= 0) {
+        return false;
+      }
+      in.append(chunk, n);
+    }
+    WireReply h;
+    memcpy(&h, in.data() + consumed, sizeof(h));
+    const unsigned char *bytes =
+        (const unsigned char *)in.data() + consumed + sizeof(h);
+    r.status = h.status;
+    r.addr = h.addr;
+    r.sync = h.sync != 0;
+    r.data = (h.status == REPLY_HIT || h.status == REPLY_EVICTED)
+                 ? makeData((DataType)h.type, bytes, h.size)
+                 : nullptr;
+    consumed += size;
+    return true;
+  }
+
+  // nullptr on a miss or a lost connection; the caller deletes the value
+  Data *read(int addr) {
+    send(OP_READ, addr);
+    Reply r;
+    return (flush() && receive(r)) ? r.data : nullptr;
+  }
+  // like Cache::put and Cache::write: the victim, if any, is the caller's
+  Elem *put(int addr, Data *data) { return change(OP_PUT, addr, data); }
+  Elem *write(int addr, Data *data) { return change(OP_WRITE, addr, data); }
+
+private:
+  Elem *change(char op, int addr, Data *data) {
+    send(op, addr, data);
+    Reply r;
+    if (!flush() || !receive(r) || r.status != REPLY_EVICTED) {
+      return nullptr;
+    }
+    return new Elem(r.addr, r.data, r.sync);
+  }
+};
+
+#endif
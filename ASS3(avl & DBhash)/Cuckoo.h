@@ -0,0 +1,431 @@
+#ifndef CUCKOO_H
+#define CUCKOO_H
+
+#include "Cache.h"
+#include <atomic>
+#include <thread>
+
+// Bucketized cuckoo hashing that many threads may use at once. Every key
+// has two buckets of four slots, and each slot keeps an 8-bit tag of the
+// key's hash, so a lookup compares the key only where the tag matches.
+// The second bucket is derived from the first and the tag alone, which
+// lets an insert plan a chain of displacements without touching keys.
+//
+// Each bucket has a version that is odd while a writer holds it. A search
+// takes no lock: it reads the versions of both buckets, scans them, and
+// starts over if either version moved. Insert, delete and relocate lock
+// the two buckets of their key, lower index first. An insert whose
+// buckets are full finds the shortest chain of entries to shift into
+// their other buckets by breadth-first search, then moves them from the
+// free end back, two buckets at a time. If there is no such chain the
+// table doubles: every bucket of the old one is locked while its entries
+// are copied, and the old one is kept until the engine goes, as a search
+// may still be reading it. Threads may change different keys at once.
+//
+// The cache may hold two entries of one address, so delete and relocate
+// find theirs by the Elem it was inserted for; which of the two a search
+// returns is unspecified.
+class CuckooEngine final : public SearchEngine {
+  static const int WAYS = 4;
+  static const int MAX_PATH = 5;   // displacements in one insert
+  static const int MAX_NODES = 512; // buckets a path search visits
+  static const int MAX_TRIES = 16;  // path searches before growing
+
+  struct alignas(64) Bucket {
+    atomic<uint32_t> version;
+    atomic<uint32_t> tags; // byte i is the tag in slot i, 0 if empty
+    atomic<int> key[WAYS], idx[WAYS];
+  };
+  struct Step {
+    int bucket, parent, slot; // entry slot of parent moves into bucket
+  };
+
+  static uint32_t tagOf(uint64_t h) {
+    uint32_t tag = (uint32_t)(h >> 56);
+    return (tag != 0) ? tag : 1;
+  }
+  // slots of tags holding tag, as the high bit of each byte
+  static uint32_t matches(uint32_t tags, uint32_t tag) {
+    uint32_t x = tags ^ (tag * 0x01010101u);
+    return (x - 0x01010101u) & ~x & 0x80808080u;
+  }
+  // a byte may be flagged wrongly above a real match, so each is checked
+  static int slotOf(uint32_t tags, uint32_t tag, uint32_t &bits) {
+    while (bits != 0) {
+      int s = lowestBit(bits) >> 3;
+      bits &= bits - 1;
+      if (((tags >> (8 * s)) & 0xff) == tag) {
+        return s;
+      }
+    }
+    return -1;
+  }
+
+  struct Table {
+    Bucket *buckets;
+    // whose entry each slot holds, [b * WAYS + s]; only read by writers
+    // with b locked, so a search touches one line per bucket
+    const Elem **owner;
+    int count, mask;
+
+    Table(int count) : count(count), mask(count - 1) {
+      buckets = new Bucket[count]();
+      owner = new const Elem *[count * WAYS]();
+    }
+    ~Table() {
+      delete[] buckets;
+      delete[] owner;
+    }
+
+    // the other bucket of any key with this tag in bucket b
+    int alt(int b, uint32_t tag) {
+      int delta = (int)((tag * 0x5bd1e995u) >> 8) & mask;
+      return b ^ ((delta != 0) ? delta : 1);
+    }
+    void locate(int address, int &b1, int &b2, uint32_t &tag) {
+      uint64_t h = mix64((uint32_t)address);
+      tag = tagOf(h);
+      b1 = (int)(h & mask);
+      b2 = alt(b1, tag);
+    }
+    int freeSlot(int b) {
+      uint32_t tags = buckets[b].tags.load(memory_order_relaxed);
+      uint32_t bits = matches(tags, 0);
+      return slotOf(tags, 0, bits);
+    }
+    // the slot of address in b, -1 if it is not there
+    int find(int b, int address, uint32_t tag) {
+      Bucket &k = buckets[b];
+      uint32_t tags = k.tags.load(memory_order_relaxed);
+      uint32_t bits = matches(tags, tag);
+      for (int s; (s = slotOf(tags, tag, bits)) >= 0;) {
+        if (k.key[s].load(memory_order_relaxed) == address) {
+          return s;
+        }
+      }
+      return -1;
+    }
+    // the slot of e's entry in b, -1 if it is not there
+    int find(int b, const Elem *e, uint32_t tag) {
+      uint32_t tags = buckets[b].tags.load(memory_order_relaxed);
+      uint32_t bits = matches(tags, tag);
+      for (int s; (s = slotOf(tags, tag, bits)) >= 0;) {
+        if (owner[b * WAYS + s] == e) {
+          return s;
+        }
+      }
+      return -1;
+    }
+    void setTag(int b, int s, uint32_t tag) {
+      uint32_t tags = buckets[b].tags.load(memory_order_relaxed);
+      tags = (tags & ~(0xffu << (8 * s))) | (tag << (8 * s));
+      buckets[b].tags.store(tags, memory_order_relaxed);
+    }
+    void place(int b, int s, int address, int idx, const Elem *e,
+               uint32_t tag) {
+      buckets[b].key[s].store(address, memory_order_relaxed);
+      buckets[b].idx[s].store(idx, memory_order_relaxed);
+      owner[b * WAYS + s] = e;
+      setTag(b, s, tag);
+    }
+
+    void lock(int b) {
+      atomic<uint32_t> &v = buckets[b].version;
+      for (;;) {
+        uint32_t seen = v.load(memory_order_relaxed);
+        if ((seen & 1) == 0 &&
+            v.compare_exchange_weak(seen, seen + 1, memory_order_acquire)) {
+          atomic_thread_fence(memory_order_release); // odd before any change
+          return;
+        }
+        this_thread::yield();
+      }
+    }
+    void unlock(int b) {
+      buckets[b].version.fetch_add(1, memory_order_release);
+    }
+    void lock(int b1, int b2) {
+      lock(min(b1, b2));
+      if (b1 != b2) {
+        lock(max(b1, b2));
+      }
+    }
+    void unlock(int b1, int b2) {
+      unlock(b1);
+      if (b1 != b2) {
+        unlock(b2);
+      }
+    }
+  };
+
+  atomic<Table *> table;
+  vector<Table *> retired; // grown out of; a search may still be in one
+  atomic<uint64_t> failedInserts;
+
+  // the current table, with the buckets of address locked in it
+  Table *lockKey(int address, int &b1, int &b2, uint32_t &tag) {
+    for (;;) {
+      Table *t = table.load(memory_order_acquire);
+      t->locate(address, b1, b2, tag);
+      t->lock(b1, b2);
+      if (table.load(memory_order_relaxed) == t) {
+        return t;
+      }
+      t->unlock(b1, b2); // it grew while we waited
+    }
+  }
+
+  // frees a slot in b1 or b2 by shifting entries along the shortest
+  // chain found; false if there is none within MAX_PATH. Also true if
+  // another thread changed the chain first, so the insert looks again.
+  bool makeRoom(Table &t, int b1, int b2) {
+    vector<Step> nodes = {{b1, -1, -1}, {b2, -1, -1}};
+    vector<int> depth = {0, 0};
+    int end = -1;
+    for (size_t n = 0; n < nodes.size() && end < 0; n++) {
+      int b = nodes[n].bucket;
+      uint32_t tags = t.buckets[b].tags.load(memory_order_relaxed);
+      for (int s = 0; s < WAYS && end < 0; s++) {
+        uint32_t tag = (tags >> (8 * s)) & 0xff;
+        if (tag == 0) {
+          return true; // freed since the insert looked
+        }
+        int next = t.alt(b, tag);
+        if (t.freeSlot(next) >= 0) {
+          end = (int)nodes.size();
+        } else if (depth[n] + 1 >= MAX_PATH ||
+                   (int)nodes.size() >= MAX_NODES) {
+          continue;
+        }
+        nodes.push_back({next, (int)n, s});
+        depth.push_back(depth[n] + 1);
+      }
+    }
+    // move from the free end back towards b1 or b2
+    for (int n = end; n >= 0 && nodes[n].parent >= 0; n = nodes[n].parent) {
+      int from = nodes[nodes[n].parent].bucket, to = nodes[n].bucket;
+      int s = nodes[n].slot;
+      t.lock(from, to);
+      if (table.load(memory_order_relaxed) != &t) {
+        t.unlock(from, to);
+        return true; // grown by another insert
+      }
+      uint32_t tag =
+          (t.buckets[from].tags.load(memory_order_relaxed) >> (8 * s)) & 0xff;
+      int free = t.freeSlot(to);
+      bool moved = tag == 0 || (t.alt(from, tag) == to && free >= 0);
+      if (tag != 0 && moved) {
+        Bucket &src = t.buckets[from];
+        t.place(to, free, src.key[s].load(memory_order_relaxed),
+                src.idx[s].load(memory_order_relaxed),
+                t.owner[from * WAYS + s], tag);
+        t.setTag(from, s, 0);
+      }
+      t.unlock(from, to);
+      if (!moved) {
+        return true;
+      }
+    }
+    return end >= 0;
+  }
+
+  // t's entries in a table of count buckets, nullptr if one finds both of
+  // its buckets full there
+  static Table *rehash(Table &t, int count) {
+    Table *n = new Table(count);
+    for (int b = 0; b < t.count; b++) {
+      uint32_t tags = t.buckets[b].tags.load(memory_order_relaxed);
+      for (int s = 0; s < WAYS; s++) {
+        if (((tags >> (8 * s)) & 0xff) == 0) {
+          continue;
+        }
+        int address = t.buckets[b].key[s].load(memory_order_relaxed);
+        int b1, b2;
+        uint32_t tag;
+        n->locate(address, b1, b2, tag);
+        int to = b1, free = n->freeSlot(b1);
+        if (free < 0) {
+          to = b2;
+          free = n->freeSlot(b2);
+        }
+        if (free < 0) {
+          delete n;
+          return nullptr;
+        }
+        n->place(to, free, address,
+                 t.buckets[b].idx[s].load(memory_order_relaxed),
+                 t.owner[b * WAYS + s], tag);
+      }
+    }
+    return n;
+  }
+  // doubles t, unless another insert already has
+  void grow(Table *t) {
+    for (int b = 0; b < t->count; b++) {
+      t->lock(b);
+    }
+    if (table.load(memory_order_relaxed) == t) {
+      Table *n = nullptr;
+      for (int count = 2 * t->count; n == nullptr; count *= 2) {
+        n = rehash(*t, count);
+      }
+      table.store(n, memory_order_release);
+      retired.push_back(t);
+    }
+    for (int b = 0; b < t->count; b++) {
+      t->unlock(b);
+    }
+  }
+
+public:
+  // room for at least slots entries, rounded up to a power of two buckets
+  CuckooEngine(int slots) : failedInserts(0) {
+    int count = 2;
+    while (count * WAYS < slots) {
+      count <<= 1;
+    }
+    table = new Table(count);
+  }
+  ~CuckooEngine() {
+    delete table.load();
+    for (Table *t : retired) {
+      delete t;
+    }
+  }
+
+  int search(int address) {
+    for (;;) {
+      Table *t = table.load(memory_order_acquire);
+      int b1, b2;
+      uint32_t tag;
+      t->locate(address, b1, b2, tag);
+      uint32_t v1 = t->buckets[b1].version.load(memory_order_acquire);
+      uint32_t v2 = t->buckets[b2].version.load(memory_order_acquire);
+      if (((v1 | v2) & 1) != 0) {
+        this_thread::yield(); // a writer holds one of them
+        continue;
+      }
+      int b = b1, s = t->find(b1, address, tag);
+      if (s < 0) {
+        b = b2;
+        s = t->find(b2, address, tag);
+      }
+      int idx =
+          (s >= 0) ? t->buckets[b].idx[s].load(memory_order_relaxed) : -1;
+      atomic_thread_fence(memory_order_acquire);
+      if (t->buckets[b1].version.load(memory_order_relaxed) == v1 &&
+          t->buckets[b2].version.load(memory_order_relaxed) == v2 &&
+          table.load(memory_order_relaxed) == t) {
+        return idx;
+      }
+    }
+  }
+  void searchBatch(const int *key, int n, int *idx) {
+    for (int base = 0; base < n; base += PREFETCH_GROUP) {
+      int m = min(PREFETCH_GROUP, n - base);
+      for (int j = 0; j < m; j++) {
+        prefetch(key[base + j]);
+      }
+      for (int j = 0; j < m; j++) {
+        idx[base + j] = search(key[base + j]);
+      }
+    }
+  }
+  void prefetch(int key) {
+    Table *t = table.load(memory_order_relaxed);
+    int b1, b2;
+    uint32_t tag;
+    t->locate(key, b1, b2, tag);
+    PREFETCH(&t->buckets[b1]);
+    PREFETCH(&t->buckets[b2]);
+  }
+  void insert(Elem *e, int idx) {
+    int b1, b2, tries = 0;
+    uint32_t tag;
+    for (;;) {
+      Table *t = lockKey(e->addr, b1, b2, tag);
+      int b = b1, s = t->freeSlot(b1);
+      if (s < 0) {
+        b = b2;
+        s = t->freeSlot(b2);
+      }
+      if (s >= 0) {
+        t->place(b, s, e->addr, idx, e, tag);
+      }
+      t->unlock(b1, b2);
+      if (s >= 0) {
+        return;
+      }
+      if (++tries > MAX_TRIES || !makeRoom(*t, b1, b2)) {
+        failedInserts++; // no room without growing
+        grow(t);
+        tries = 0;
+      }
+    }
+  }
+  void deleteNode(Elem *e) {
+    if (e == nullptr) {
+      return;
+    }
+    int b1, b2;
+    uint32_t tag;
+    Table *t = lockKey(e->addr, b1, b2, tag);
+    for (int b : {b1, b2}) {
+      int s = t->find(b, e, tag);
+      if (s >= 0) {
+        t->setTag(b, s, 0);
+        t->owner[b * WAYS + s] = nullptr;
+        break;
+      }
+    }
+    t->unlock(b1, b2);
+  }
+  void relocate(Elem *e, int idx) {
+    int b1, b2;
+    uint32_t tag;
+    Table *t = lockKey(e->addr, b1, b2, tag);
+    for (int b : {b1, b2}) {
+      int s = t->find(b, e, tag);
+      if (s >= 0) {
+        t->buckets[b].idx[s].store(idx, memory_order_relaxed);
+        break;
+      }
+    }
+    t->unlock(b1, b2);
+  }
+  void print(ReplacementPolicy *q, ostream &os) {
+    Table *t = table.load(memory_order_relaxed);
+    os << "Prime memory:" << endl;
+    for (int b = 0; b < t->count; b++) {
+      uint32_t tags = t->buckets[b].tags.load(memory_order_relaxed);
+      for (int s = 0; s < WAYS; s++) {
+        int idx = t->buckets[b].idx[s].load(memory_order_relaxed);
+        if (((tags >> (8 * s)) & 0xff) != 0)
+          q->getValue(idx)->print(os);
+      }
+    }
+  }
+  void diagnose(EngineStats &out) {
+    Table *t = table.load(memory_order_relaxed);
+    out.slots = t->count * WAYS;
+    out.missProbes = 2; // buckets
+    out.failedInserts = failedInserts;
+    out.probeLengths.assign(2, 0); // in the first bucket, in the second
+    for (int b = 0; b < t->count; b++) {
+      uint32_t tags = t->buckets[b].tags.load(memory_order_relaxed);
+      for (int s = 0; s < WAYS; s++) {
+        if (((tags >> (8 * s)) & 0xff) == 0) {
+          continue;
+        }
+        int b1, b2;
+        uint32_t tag;
+        t->locate(t->buckets[b].key[s].load(memory_order_relaxed), b1, b2,
+                  tag);
+        out.entries++;
+        out.probeLengths[b != b1]++;
+      }
+    }
+  }
+};
+
+#endif
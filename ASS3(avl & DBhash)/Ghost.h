@@ -0,0 +1,78 @@
+#ifndef GHOST_H
+#define GHOST_H
+
+#include "Cache.h"
+#include "Trace.h"
+#include <chrono>
+#include <thread>
+
+// A cache that keeps only the keys: entries carry no Data, so a replay
+// costs the engine and policy work and nothing else. Reads that miss are
+// followed by a put, as in simulate.
+class GhostCache : public BasicCache<SearchEngine, ReplacementPolicy> {
+public:
+  GhostCache(SearchEngine *s, ReplacementPolicy *r)
+      : BasicCache<SearchEngine, ReplacementPolicy>(s, r) {}
+  void replay(const TraceRecord &rec) {
+    if (rec.code == 'R') {
+      if (admission != nullptr) {
+        admission->record(rec.addr);
+      }
+      int idx = s_engine->search(rec.addr);
+      bool hit = rp->getValue(idx) != nullptr;
+      rp->access(idx);
+      counters.reads++;
+      counters.readHits += hit;
+      if (!hit) {
+        missPending = true; // the put below fills this read
+        missedAddr = rec.addr;
+        delete put(rec.addr, nullptr);
+      }
+    } else if (rec.code == 'W') {
+      delete write(rec.addr, nullptr);
+    } else {
+      delete put(rec.addr, nullptr);
+    }
+  }
+};
+
+struct GhostResult {
+  string policy, admission;
+  CacheStats stats;
+  double seconds;
+};
+
+// Replays trace through one ghost cache per policy and admission filter
+// pair, each on its own thread
+vector<GhostResult> shadow(const vector<TraceRecord> &trace,
+                           const vector<string> &policies,
+                           const string &engine, int capacity,
+                           const vector<string> &admissions = {"none"}) {
+  vector<GhostResult> results(policies.size() * admissions.size());
+  vector<thread> threads;
+  for (size_t i = 0; i < results.size(); i++) {
+    threads.push_back(thread([&, i] {
+      const string &policy = policies[i / admissions.size()];
+      const string &admission = admissions[i % admissions.size()];
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      GhostCache ghost(makeEngine(engine, capacity),
+                       makePolicy(policy, capacity));
+      ghost.setAdmission(makeAdmission(admission, capacity));
+      for (const TraceRecord &rec : trace) {
+        ghost.replay(rec);
+      }
+      results[i].policy = policy;
+      results[i].admission = admission;
+      results[i].stats = ghost.getStats();
+      results[i].seconds = chrono::duration<double>(
+                               chrono::steady_clock::now() - start)
+                               .count();
+    }));
+  }
+  for (thread &t : threads) {
+    t.join();
+  }
+  return results;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "main.h"
+
+// Wire format of the cache server: the R, U and W trace operations as
+// fixed 12-byte headers, each followed by size value bytes. Responses
+// come back in request order, so a client may send many requests before
+// it reads any replies.
+
+const char OP_READ = 'R', OP_PUT = 'U', OP_WRITE = 'W';
+const char REPLY_HIT = 'H';     // the value follows
+const char REPLY_MISS = 'M';    // no value
+const char REPLY_OK = 'K';      // put or write, nothing evicted
+const char REPLY_EVICTED = 'E'; // put or write; the victim follows
+const uint32_t MAX_VALUE = 1 << 20;
+
+struct WireRequest {
+  char op, type, pad[2]; // type of the value, for U and W
+  int addr;
+  uint32_t size;
+};
+
+struct WireReply {
+  char status, type, sync, pad;
+  int addr; // the victim's, for REPLY_EVICTED
+  uint32_t size;
+};
+
+inline void appendRaw(string &buf, const void *p, size_t n) {
+  buf.append((const char *)p, n);
+}
+
+void appendRequest(string &buf, char op, int addr, Data *data) {
+  SharedBuffer bytes = (data != nullptr) ? data->share() : SharedBuffer();
+  WireRequest r = {op,
+                   (char)((data != nullptr) ? data->getType() : INT_DATA),
+                   {0, 0},
+                   addr,
+                   (uint32_t)bytes.size()};
+  appendRaw(buf, &r, sizeof(r));
+  appendRaw(buf, bytes.data(), bytes.size());
+}
+
+void appendReply(string &buf, char status, int addr, Data *data, bool sync) {
+  SharedBuffer bytes = (data != nullptr) ? data->share() : SharedBuffer();
+  WireReply r = {status,
+                 (char)((data != nullptr) ? data->getType() : INT_DATA),
+                 (char)sync,
+                 0,
+                 addr,
+                 (uint32_t)bytes.size()};
+  appendRaw(buf, &r, sizeof(r));
+  appendRaw(buf, bytes.data(), bytes.size());
+}
+
+// bytes of the whole message starting at p, 0 if it is not all in yet
+template <class Header> size_t messageSize(const char *p, size_t avail) {
+  if (avail < sizeof(Header)) {
+    return 0;
+  }
+  Header h;
+  memcpy(&h, p, sizeof(h));
+  return (avail - sizeof(h) >= h.size) ? sizeof(h) + h.size : 0;
+}
+
+bool validType(char type) { return type >= INT_DATA && type <= BLOB_DATA; }
+
+#endif
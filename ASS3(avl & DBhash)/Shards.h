@@ -0,0 +1,171 @@
+#ifndef SHARDS_H
+#define SHARDS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Miss ratio curve of an address stream by spatial sampling (SHARDS,
+// Waldspurger et al., FAST '15). An address is tracked only if its hash
+// falls under a threshold, so about rate of the addresses are seen, and
+// their reuse distances are scaled up by 1 / rate. Reuse distance is the
+// LRU stack distance, so the curve predicts an LRU cache of each size.
+// With maxKeys > 0 the threshold is lowered whenever more than maxKeys
+// addresses are tracked, which bounds the memory.
+class Shards {
+  static const uint32_t MODULUS = 1 << 24;
+  uint32_t threshold; // an address is sampled if its hash is below
+  size_t maxKeys;
+  unordered_map<int, int> last;              // address -> time of last use
+  priority_queue<pair<uint32_t, int>> byHash; // only with maxKeys
+  vector<int> tree; // Fenwick tree over time, 1 at each address's last use
+  int now;
+  int bucket;          // width of a histogram bucket in scaled distance
+  vector<double> hist; // reuses by scaled distance / bucket
+  double cold;         // first uses, infinite distance
+  uint64_t references, sampled;
+
+  // murmur3 finalizer; the multiply first keeps it apart from the
+  // multiplicative scrambling traces use to spread hot keys
+  static uint32_t hashOf(int addr) {
+    uint32_t h = (uint32_t)addr * 0x9e3779b1u + 7;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h & (MODULUS - 1);
+  }
+  void add(int i, int d) {
+    for (; i < (int)tree.size(); i += i & -i) {
+      tree[i] += d;
+    }
+  }
+  int sum(int i) {
+    int s = 0;
+    for (; i > 0; i -= i & -i) {
+      s += tree[i];
+    }
+    return s;
+  }
+  // renumbers the last uses 1..n so the time line fits again
+  void compact() {
+    vector<pair<int, int>> live; // time, address
+    for (auto &entry : last) {
+      live.push_back(make_pair(entry.second, entry.first));
+    }
+    sort(live.begin(), live.end());
+    tree.assign(2 * live.size() + 1024, 0);
+    for (size_t i = 0; i < live.size(); i++) {
+      last[live[i].second] = (int)i + 1;
+      add((int)i + 1, 1);
+    }
+    now = (int)live.size();
+  }
+  // lowers the threshold until at most maxKeys addresses are tracked
+  void shrink() {
+    uint32_t before = threshold;
+    while (last.size() > maxKeys && !byHash.empty()) {
+      threshold = byHash.top().first;
+      while (!byHash.empty() && byHash.top().first >= threshold) {
+        int addr = byHash.top().second;
+        byHash.pop();
+        add(last[addr], -1);
+        last.erase(addr);
+      }
+    }
+    // counts so far were taken at the higher rate
+    double scale = (double)threshold / before;
+    for (double &count : hist) {
+      count *= scale;
+    }
+    cold *= scale;
+  }
+
+public:
+  Shards(double rate = 0.01, size_t maxKeys = 0)
+      : maxKeys(maxKeys), tree(1024, 0), now(0), cold(0), references(0),
+        sampled(0) {
+    rate = min(max(rate, 1.0 / MODULUS), 1.0);
+    threshold = (uint32_t)(rate * MODULUS);
+    bucket = max(1, (int)(1 / rate));
+  }
+  double rate() const { return (double)threshold / MODULUS; }
+  uint64_t getReferences() const { return references; }
+  uint64_t getSampled() const { return sampled; }
+  int maxDistance() const { return (int)hist.size() * bucket; }
+
+  void access(int addr) {
+    references++;
+    uint32_t h = hashOf(addr);
+    if (h >= threshold) {
+      return;
+    }
+    sampled++;
+    if (now + 1 >= (int)tree.size()) {
+      compact();
+    }
+    now++;
+    auto it = last.find(addr);
+    if (it == last.end()) {
+      cold++;
+      last[addr] = now;
+      add(now, 1);
+      if (maxKeys > 0) {
+        byHash.push(make_pair(h, addr));
+        if (last.size() > maxKeys) {
+          shrink();
+        }
+      }
+      return;
+    }
+    // distinct sampled addresses used since the last use of addr
+    int distance = sum(now - 1) - sum(it->second);
+    add(it->second, -1);
+    it->second = now;
+    add(now, 1);
+    size_t b = (size_t)(distance / rate()) / bucket;
+    if (b >= hist.size()) {
+      hist.resize(b + 1, 0);
+    }
+    hist[b]++;
+  }
+
+  // predicted hit ratio of an LRU cache holding capacity addresses
+  double hitRatio(int capacity) const {
+    double total = cold, hits = 0;
+    for (size_t b = 0; b < hist.size(); b++) {
+      total += hist[b];
+      if ((b + 1) * bucket <= (size_t)capacity) {
+        hits += hist[b];
+      }
+    }
+    return (total > 0) ? hits / total : 0;
+  }
+
+  // capacities evenly spaced up to the largest distance seen
+  vector<int> defaultCapacities(int points = 20) const {
+    vector<int> caps;
+    int top = max(maxDistance(), points);
+    for (int i = 1; i <= points; i++) {
+      caps.push_back((int)((long long)top * i / points));
+    }
+    return caps;
+  }
+
+  void print(ostream &os, const vector<int> &capacities) const {
+    os << "references " << references << " sampled " << sampled << " rate "
+       << rate() << endl;
+    for (int capacity : capacities) {
+      os << "capacity " << capacity << " hit ratio " << hitRatio(capacity)
+         << endl;
+    }
+  }
+};
+
+#endif
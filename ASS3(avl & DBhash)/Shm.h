@@ -0,0 +1,353 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "main.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// An LRU cache that lives entirely in a POSIX shared-memory segment, so
+// every process that maps it sees the same entries. Nothing in the
+// segment is a pointer: slots, hash chains and the LRU list link by slot
+// index, which means the same in every mapping. One process-shared mutex
+// guards the whole segment. It is robust: if a process dies holding it,
+// the next one to lock it clears the cache, since the dead process may
+// have left a list half linked.
+//
+// Values are copied in and out, up to valueBytes each, so what read
+// returns stays valid whatever other processes do. A put of an address
+// already cached replaces its value. A larger value is not cached and is
+// handed back to the caller as the victim.
+class SharedCache {
+  static constexpr uint64_t MAGIC = 0x31484d5348435641ULL; // "AVCHSMH1"
+  static constexpr int NIL = -1;
+
+  struct Header {
+    uint64_t magic; // set last by the creator
+    int capacity, buckets, valueBytes, count;
+    int head, tail, freeList; // LRU: head is the most recent
+    pthread_mutex_t lock;
+    uint64_t reads, readHits, puts, writes, writeHits, evictions, rejected,
+        recoveries;
+  };
+  struct Slot {
+    int addr;
+    int chain;      // next slot in the same bucket
+    int prev, next; // LRU list, or next free slot
+    char type, sync, pad[2];
+    uint32_t size;
+    // followed by valueBytes of value, slot size rounded up to 8
+  };
+
+  void *base;
+  size_t length;
+  Header *h;
+  int *table;     // buckets slot indices
+  char *slotBase; // capacity slots of slotSize bytes
+  size_t slotSize;
+
+  static size_t slotBytes(int valueBytes) {
+    return (sizeof(Slot) + valueBytes + 7) & ~(size_t)7;
+  }
+  static size_t segmentBytes(int capacity, int buckets, int valueBytes) {
+    size_t header = (sizeof(Header) + 63) & ~(size_t)63;
+    size_t table = ((size_t)buckets * sizeof(int) + 63) & ~(size_t)63;
+    return header + table + (size_t)capacity * slotBytes(valueBytes);
+  }
+  static string shmName(const string &name) {
+    return (name[0] == '/') ? name : "/" + name;
+  }
+
+  SharedCache(void *base, size_t length) : base(base), length(length) {
+    h = (Header *)base;
+    table = (int *)((char *)base + ((sizeof(Header) + 63) & ~(size_t)63));
+    slotBase = (char *)table +
+               (((size_t)h->buckets * sizeof(int) + 63) & ~(size_t)63);
+    slotSize = slotBytes(h->valueBytes);
+  }
+
+  Slot *slot(int i) { return (Slot *)(slotBase + (size_t)i * slotSize); }
+  unsigned char *value(Slot *s) { return (unsigned char *)(s + 1); }
+  int bucket(int addr) {
+    return (int)(mix64((uint32_t)addr) & (h->buckets - 1));
+  }
+
+  // empties the cache; the caller holds the lock or is the creator
+  void clear() {
+    fill(table, table + h->buckets, NIL);
+    for (int i = 0; i < h->capacity; i++) {
+      slot(i)->next = (i + 1 < h->capacity) ? i + 1 : NIL;
+    }
+    h->freeList = (h->capacity > 0) ? 0 : NIL;
+    h->head = h->tail = NIL;
+    h->count = 0;
+  }
+  void lock() {
+    if (pthread_mutex_lock(&h->lock) == EOWNERDEAD) {
+      clear();
+      h->recoveries++;
+      pthread_mutex_consistent(&h->lock);
+    }
+  }
+  void unlock() { pthread_mutex_unlock(&h->lock); }
+
+  int find(int addr) {
+    int i = table[bucket(addr)];
+    while (i != NIL && slot(i)->addr != addr) {
+      i = slot(i)->chain;
+    }
+    return i;
+  }
+  void unlinkLru(int i) {
+    Slot *s = slot(i);
+    (s->prev != NIL ? slot(s->prev)->next : h->head) = s->next;
+    (s->next != NIL ? slot(s->next)->prev : h->tail) = s->prev;
+  }
+  void pushFront(int i) {
+    Slot *s = slot(i);
+    s->prev = NIL;
+    s->next = h->head;
+    (h->head != NIL ? slot(h->head)->prev : h->tail) = i;
+    h->head = i;
+  }
+  void unchain(int i) {
+    int *link = &table[bucket(slot(i)->addr)];
+    while (*link != i) {
+      link = &slot(*link)->chain;
+    }
+    *link = slot(i)->chain;
+  }
+  Elem *copyOut(Slot *s) {
+    return new Elem(s->addr, makeData((DataType)s->type, value(s), s->size),
+                    s->sync != 0);
+  }
+  bool fits(Data *cont) { return cont->getSize() <= (size_t)h->valueBytes; }
+  // stores the value in s, which it must fit
+  void assign(Slot *s, Data *cont, bool sync) {
+    SharedBuffer bytes = cont->share();
+    memcpy(value(s), bytes.data(), bytes.size());
+    s->size = (uint32_t)bytes.size();
+    s->type = (char)cont->getType();
+    s->sync = sync;
+  }
+  // caches addr, evicting the least recent entry if full; returns the
+  // victim's copy
+  Elem *insert(int addr, Data *cont, bool sync) {
+    int i = find(addr);
+    if (i != NIL) { // a put of a cached address
+      assign(slot(i), cont, sync);
+      unlinkLru(i);
+      pushFront(i);
+      return nullptr;
+    }
+    Elem *victim = nullptr;
+    if (h->freeList != NIL) {
+      i = h->freeList;
+      h->freeList = slot(i)->next;
+      h->count++;
+    } else {
+      i = h->tail;
+      victim = copyOut(slot(i));
+      unlinkLru(i);
+      unchain(i);
+      h->evictions++;
+    }
+    Slot *s = slot(i);
+    s->addr = addr;
+    assign(s, cont, sync);
+    int b = bucket(addr);
+    s->chain = table[b];
+    table[b] = i;
+    pushFront(i);
+    return victim;
+  }
+
+  // A value that does not fit is not cached. It comes back as the victim,
+  // taking cont, and a cached copy of addr is freed as out of date.
+  Elem *reject(int addr, Data *cont, bool sync) {
+    int i = find(addr);
+    if (i != NIL) {
+      unlinkLru(i);
+      unchain(i);
+      slot(i)->next = h->freeList;
+      h->freeList = i;
+      h->count--;
+    }
+    h->rejected++;
+    return new Elem(addr, cont, sync);
+  }
+
+public:
+  ~SharedCache() { munmap(base, length); }
+
+  // A new segment; nullptr if name exists or capacity < 1
+  static SharedCache *create(const string &name, int capacity,
+                             int valueBytes = 64) {
+    if (capacity < 1 || valueBytes < (int)sizeof(int)) {
+      return nullptr;
+    }
+    int buckets = 1;
+    while (buckets < 2 * capacity) {
+      buckets <<= 1;
+    }
+    size_t length = segmentBytes(capacity, buckets, valueBytes);
+    int fd = shm_open(shmName(name).c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+      return nullptr;
+    }
+    void *base = MAP_FAILED;
+    if (ftruncate(fd, length) == 0) {
+      base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+      shm_unlink(shmName(name).c_str());
+      return nullptr;
+    }
+    Header *h = (Header *)base; // the new pages are zero
+    h->capacity = capacity;
+    h->buckets = buckets;
+    h->valueBytes = valueBytes;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&h->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    SharedCache *c = new SharedCache(base, length);
+    c->clear();
+    __atomic_store_n(&h->magic, MAGIC, __ATOMIC_RELEASE);
+    return c;
+  }
+  // Maps an existing segment; nullptr if there is none or its creator
+  // has not finished setting it up within a second
+  static SharedCache *attach(const string &name) {
+    int fd = shm_open(shmName(name).c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st;
+    void *base = MAP_FAILED;
+    for (int tries = 0; tries < 1000; tries++) {
+      if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(Header)) {
+        break;
+      }
+      usleep(1000);
+    }
+    if (st.st_size >= (off_t)sizeof(Header)) {
+      base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                  0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+      return nullptr;
+    }
+    Header *h = (Header *)base;
+    for (int tries = 0; tries < 1000; tries++) {
+      if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == MAGIC) {
+        if ((size_t)st.st_size <
+            segmentBytes(h->capacity, h->buckets, h->valueBytes)) {
+          break;
+        }
+        return new SharedCache(base, st.st_size);
+      }
+      usleep(1000);
+    }
+    munmap(base, st.st_size);
+    return nullptr;
+  }
+  // Removes the name; processes that have it mapped keep using it
+  static bool remove(const string &name) {
+    return shm_unlink(shmName(name).c_str()) == 0;
+  }
+
+  // a copy of the value, the caller's to delete; nullptr on a miss
+  Data *read(int addr) {
+    lock();
+    int i = find(addr);
+    Data *data = nullptr;
+    if (i != NIL) {
+      Slot *s = slot(i);
+      data = makeData((DataType)s->type, value(s), s->size);
+      unlinkLru(i);
+      pushFront(i);
+    }
+    h->reads++;
+    h->readHits += i != NIL;
+    unlock();
+    return data;
+  }
+  // As in Cache, put and write take ownership of cont and return the
+  // victim, here a copy. A value larger than valueBytes is returned as the
+  // victim itself, unsynced for a write, and drops any cached copy.
+  Elem *put(int addr, Data *cont) {
+    lock();
+    bool fit = fits(cont);
+    Elem *victim = fit ? insert(addr, cont, true) : reject(addr, cont, true);
+    h->puts++;
+    unlock();
+    if (fit) {
+      delete cont;
+    }
+    return victim;
+  }
+  Elem *write(int addr, Data *cont) {
+    lock();
+    int i = find(addr);
+    bool fit = fits(cont);
+    Elem *victim = nullptr;
+    if (!fit) {
+      victim = reject(addr, cont, false);
+    } else if (i == NIL) {
+      victim = insert(addr, cont, false);
+    } else {
+      assign(slot(i), cont, false);
+      unlinkLru(i);
+      pushFront(i);
+    }
+    h->writes++;
+    h->writeHits += i != NIL;
+    unlock();
+    if (fit) {
+      delete cont;
+    }
+    return victim;
+  }
+
+  int getCapacity() { return h->capacity; }
+  int getValueBytes() { return h->valueBytes; }
+  int getCount() {
+    lock();
+    int n = h->count;
+    unlock();
+    return n;
+  }
+  void printRP(ostream &os = cout) { // most recent first, as LRU prints
+    lock();
+    vector<Elem *> elems;
+    for (int i = h->head; i != NIL; i = slot(i)->next) {
+      elems.push_back(copyOut(slot(i)));
+    }
+    unlock();
+    for (Elem *e : elems) {
+      e->print(os);
+      delete e;
+    }
+  }
+  void printStats(ostream &os = cout) {
+    lock();
+    Header s = *h;
+    unlock();
+    os << "entries " << s.count << " capacity " << s.capacity
+       << " value bytes " << s.valueBytes << endl;
+    os << "reads " << s.reads << " hits " << s.readHits << " writes "
+       << s.writes << " hits " << s.writeHits << endl;
+    os << "puts " << s.puts << " evictions " << s.evictions << " rejected "
+       << s.rejected << " recoveries " << s.recoveries << endl;
+  }
+};
+
+#endif
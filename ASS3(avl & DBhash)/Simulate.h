@@ -0,0 +1,215 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include "Art.h"
+#include "Cache.h"
+#include "Cuckoo.h"
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_POSIX_FILES 1 // F and L: the spill tier and the log need them
+#include "Spill.h"
+#include "Wal.h"
+#endif
+
+// "text" is a String and 0x followed by hex digits a Blob
+Data *getData(string s) {
+  stringstream ss;
+  ss << s;
+  int idata;
+  float fdata;
+  if (s.size() >= 2 && s.front() == '"' && s.back() == '"')
+    return new String(s.substr(1, s.size() - 2));
+  else if (s.size() > 2 && s.compare(0, 2, "0x") == 0 &&
+           s.find_first_not_of("0123456789abcdefABCDEF", 2) == string::npos &&
+           s.size() % 2 == 0) {
+    vector<unsigned char> bytes;
+    for (size_t i = 2; i < s.size(); i += 2)
+      bytes.push_back((unsigned char)stoi(s.substr(i, 2), nullptr, 16));
+    return new Blob(bytes.data(), bytes.size());
+  } else if (ss >> idata)
+    return new Int(idata);
+  else if (ss >> fdata)
+    return new Float(fdata);
+  else if (s.compare("true") || s.compare("false"))
+    return new Bool(s.compare("true"));
+  else {
+    s.resize(s.size() - 1);
+    return new Address(stoi(s));
+  }
+  return NULL;
+}
+
+// Runs the commands of a trace against a fresh cache. Everything the
+// trace prints goes to out and the capacity is local, so traces can run
+// on several threads at once.
+void simulate(istream &in, ostream &out) {
+  string s;
+  int capacity = MAXSIZE; // until an M command
+  SearchEngine *sr = nullptr;
+  ReplacementPolicy *rp;
+  Cache *c = nullptr;
+  vector<Elem *> elems;
+  vector<int> addrs;
+  vector<Data *> values;
+  while (getline(in, s)) {
+    stringstream ss(s);
+    string code, tmp;
+    ss >> code;
+    int addr;
+
+    switch (code[0]) {
+    case 'M': // MAXSIZE
+      ss >> addr;
+      capacity = addr;
+      break;
+    case 'S': // Search Engine
+      ss >> tmp;
+      // E on ART prints one list in address order rather than AVL's
+      // inorder and preorder: only its leaves hold entries, so the two
+      // would be the same
+      if (tmp == "ART")
+        sr = new ART();
+      else if (tmp[0] == 'A')
+        sr = new AVL();
+      else if (tmp[0] == 'C') { // C size: cuckoo
+        ss >> addr;
+        sr = new CuckooEngine(addr);
+      } else {
+        ss >> addr; // size
+        sr = makeDBHashing(tmp[1], tmp[2], addr);
+      }
+      break;
+    case 'T': // ReplacementPolicy
+      ss >> addr;
+      if (addr == 1)
+        rp = new LRU(capacity);
+      else if (addr == 2)
+        rp = new LFU(capacity);
+      else if (addr == 3)
+        rp = new FIFO(capacity);
+      else
+        rp = new MRU(capacity);
+      c = new Cache(sr, rp);
+      break;
+    case 'R': // read
+      ss >> addr;
+      Data *res;
+      res = c->read(addr);
+      if (res == NULL) {
+        ss >> tmp;
+        delete c->put(addr, getData(tmp));
+      } else {
+        out << res->getValue() << endl;
+      }
+      break;
+    case 'U': // put
+      ss >> addr;
+      ss >> tmp;
+      delete c->put(addr, getData(tmp));
+      break;
+    case 'V': // bulk put: V addr value addr value ...
+      while (ss >> addr >> tmp) {
+        addrs.push_back(addr);
+        values.push_back(getData(tmp));
+      }
+      c->putMany(addrs.data(), values.data(), (int)addrs.size());
+      addrs.clear();
+      values.clear();
+      break;
+    case 'Q': // batch read: Q addr addr ..., prints the hits in order
+      while (ss >> addr) {
+        addrs.push_back(addr);
+      }
+      values.resize(addrs.size());
+      c->readBatch(addrs.data(), (int)addrs.size(), values.data());
+      for (Data *d : values) {
+        if (d != nullptr) {
+          out << d->getValue() << endl;
+        }
+      }
+      addrs.clear();
+      values.clear();
+      break;
+    case 'W': // write
+      ss >> addr;
+      ss >> tmp;
+      delete c->write(addr, getData(tmp));
+      break;
+    case 'P': // print
+      out << "Print replacement buffer\n";
+      c->printRP(out);
+      break;
+    case 'E': //
+      out << "Print search buffer\n";
+      c->printSE(out);
+      break;
+    case 'C': // counters
+      out << "Print cache stats\n";
+      c->printStats(out);
+#ifdef HAVE_POSIX_FILES
+      if (c->getSpill() != nullptr) {
+        c->getSpill()->print(out);
+      }
+#endif
+      break;
+    case 'N': // counters without the latencies
+      out << "Print cache counts\n";
+      c->printCounts(out);
+      break;
+    case 'K': // keys in a range: K lo hi, in address order
+      ss >> addr >> tmp;
+      out << "Print range " << addr << " " << tmp << "\n";
+      if (c->scan(addr, stoi(tmp), elems)) {
+        for (Elem *e : elems) {
+          e->print(out);
+        }
+      }
+      elems.clear();
+      break;
+    case 'D': // diagnostics
+      out << "Print search engine diagnostics\n";
+      c->printDiagnostics(out);
+      break;
+    case 'B': // byte budget, on an empty cache
+      ss >> addr;
+      c->setByteBudget(addr);
+      break;
+    case 'G': // engine growth: G maxLoad step
+      ss >> tmp >> addr;
+      c->setEngineGrowth(stod(tmp), addr);
+      break;
+#ifdef HAVE_POSIX_FILES
+    case 'F': // spill tier: F directory bytes
+      ss >> tmp >> addr;
+      c->spillTo(new SpillTier(tmp, addr));
+      break;
+    case 'L': // write-ahead log: L path replays it, then logs to it
+      ss >> tmp;
+      c->recover(tmp);
+      c->logWrites(new WriteAheadLog(tmp));
+      break;
+#endif
+    case 'A': // admission: A doorkeeper, A tinylfu, A none
+      ss >> tmp;
+      c->setAdmission(makeAdmission(tmp, capacity));
+      break;
+    case 'H': // hit ratio curve: "H rate" starts estimating, "H" prints
+      if (ss >> tmp) {
+        c->trackMissRatio(new Shards(stod(tmp)));
+      } else if (c->getMissRatio() != nullptr) {
+        Shards *mrc = c->getMissRatio();
+        out << "Print hit ratio curve\n";
+        mrc->print(out, mrc->defaultCapacities());
+      }
+      break;
+    }
+  }
+  delete c;
+}
+
+void simulate(string filename) {
+  ifstream ifs;
+  ifs.open(filename, std::ifstream::in);
+  simulate(ifs, cout);
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include "main.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+
+// Second tier for entries the cache evicts: a log of records appended to
+// fixed-size segment files mapped into memory, and an index from address
+// to the newest record. An overwritten or taken record is dead space;
+// when over half of the sealed segments is dead, the emptiest one is
+// compacted by copying its live records to the end of the log. Past
+// maxBytes the oldest segment is dropped with what is still live in it.
+// The files are scratch space: they are truncated on open and removed by
+// the destructor.
+class SpillTier final : public SecondTier {
+  struct Record { // followed by size bytes, padded to 4
+    int addr;
+    uint32_t size;
+    char type, sync, pad[2];
+  };
+  struct Segment {
+    int fd;
+    char *base;
+    size_t used, live; // bytes appended, bytes of records still indexed
+    string path;
+  };
+  struct Location {
+    int segment;
+    uint32_t offset;
+  };
+  string dir;
+  size_t maxBytes, segmentBytes;
+  map<int, Segment> segments; // by id, oldest first; the last is written
+  unordered_map<int, Location> index;
+  int nextId;
+  bool compacting;
+  uint64_t hits, stored, dropped, compactions;
+
+  static size_t recordSize(size_t n) {
+    return sizeof(Record) + ((n + 3) & ~(size_t)3);
+  }
+  bool open() { // a new segment to append to
+    Segment s;
+    s.path = dir + "/segment-" + to_string(nextId) + ".log";
+    s.fd = ::open(s.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (s.fd < 0) {
+      return false;
+    }
+    void *base = MAP_FAILED;
+    if (ftruncate(s.fd, segmentBytes) == 0) {
+      base = mmap(nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  s.fd, 0);
+    }
+    if (base == MAP_FAILED) {
+      ::close(s.fd);
+      unlink(s.path.c_str());
+      return false;
+    }
+    s.base = (char *)base;
+    s.used = s.live = 0;
+    segments[nextId++] = s;
+    return true;
+  }
+  void close(map<int, Segment>::iterator it) {
+    munmap(it->second.base, segmentBytes);
+    ::close(it->second.fd);
+    unlink(it->second.path.c_str());
+    segments.erase(it);
+  }
+  const Record *at(const Location &l) { // nullptr if the segment is gone
+    map<int, Segment>::iterator it = segments.find(l.segment);
+    if (it == segments.end()) {
+      return nullptr;
+    }
+    return (const Record *)(it->second.base + l.offset);
+  }
+  void kill(const Location &l) {
+    map<int, Segment>::iterator it = segments.find(l.segment);
+    if (it != segments.end()) {
+      const Record *r = (const Record *)(it->second.base + l.offset);
+      it->second.live -= recordSize(r->size);
+    }
+  }
+  // copies a record to the end of the log and indexes it there
+  bool append(int addr, const void *bytes, size_t n, char type, char sync) {
+    size_t size = recordSize(n);
+    if (size > segmentBytes) {
+      return false;
+    }
+    if (segments.empty() || segments.rbegin()->second.used + size >
+                                segmentBytes) {
+      if (!open()) {
+        return false;
+      }
+      if (!compacting) {
+        collect();
+      }
+      // the copies compaction made may have filled the new segment
+      if (segments.rbegin()->second.used + size > segmentBytes && !open()) {
+        return false;
+      }
+    }
+    Segment &s = segments.rbegin()->second;
+    Record *r = (Record *)(s.base + s.used);
+    r->addr = addr;
+    r->size = (uint32_t)n;
+    r->type = type;
+    r->sync = sync;
+    r->pad[0] = r->pad[1] = 0;
+    memcpy(r + 1, bytes, n);
+    index[addr] = {segments.rbegin()->first, (uint32_t)s.used};
+    s.used += size;
+    s.live += size;
+    return true;
+  }
+  // compaction and the size bound, run when a new segment is started
+  void collect() {
+    compacting = true;
+    for (;;) {
+      // copying may start a new segment, so the totals and the segment
+      // being written are looked at again on every pass
+      auto active = prev(segments.end()), emptiest = active;
+      size_t sealed = 0, live = 0;
+      for (auto it = segments.begin(); it != active; ++it) {
+        sealed += it->second.used;
+        live += it->second.live;
+        if (emptiest == active ||
+            it->second.live * emptiest->second.used <
+                emptiest->second.live * it->second.used) {
+          emptiest = it;
+        }
+      }
+      if (sealed == 0 || 2 * live >= sealed) {
+        break;
+      }
+      // a live record is the one its address is indexed at
+      Segment &s = emptiest->second;
+      bool copied = true;
+      for (size_t off = 0; copied && off < s.used;) {
+        const Record *r = (const Record *)(s.base + off);
+        auto found = index.find(r->addr);
+        if (found != index.end() && found->second.segment == emptiest->first &&
+            found->second.offset == off) {
+          copied = append(r->addr, r + 1, r->size, r->type, r->sync);
+          if (copied) {
+            s.live -= recordSize(r->size); // indexed at the copy now
+          }
+        }
+        off += recordSize(r->size);
+      }
+      if (!copied) {
+        break; // no room for the copies: the rest stays indexed here
+      }
+      close(emptiest);
+      compactions++;
+    }
+    while (segments.size() > 1 && segments.size() * segmentBytes > maxBytes) {
+      auto oldest = segments.begin();
+      Segment &s = oldest->second;
+      for (size_t off = 0; off < s.used;) {
+        const Record *r = (const Record *)(s.base + off);
+        auto found = index.find(r->addr);
+        if (found != index.end() && found->second.segment == oldest->first &&
+            found->second.offset == off) {
+          index.erase(found);
+          dropped++;
+        }
+        off += recordSize(r->size);
+      }
+      close(oldest);
+    }
+    compacting = false;
+  }
+
+public:
+  // maxBytes bounds the files, at least one segment is always kept
+  SpillTier(const string &directory, size_t maxBytes,
+            size_t segmentBytes = 1 << 20)
+      : dir(directory), maxBytes(maxBytes), segmentBytes(segmentBytes),
+        nextId(0), compacting(false), hits(0), stored(0), dropped(0),
+        compactions(0) {}
+  ~SpillTier() {
+    while (!segments.empty()) {
+      close(segments.begin());
+    }
+  }
+  // Keeps a copy of an evicted value, replacing an older one. False if it
+  // is larger than a segment or no segment file can be made.
+  bool store(int addr, Data *data, bool sync) {
+    erase(addr);
+    SharedBuffer bytes = data->share();
+    if (!append(addr, bytes.data(), bytes.size(), (char)data->getType(),
+                sync)) {
+      dropped++;
+      return false;
+    }
+    stored++;
+    return true;
+  }
+  // Removes addr from the tier and returns its value, nullptr if absent
+  Data *take(int addr, bool &sync) {
+    auto found = index.find(addr);
+    if (found == index.end()) {
+      return nullptr;
+    }
+    const Record *r = at(found->second);
+    if (r == nullptr) {
+      index.erase(found);
+      return nullptr;
+    }
+    const unsigned char *bytes = (const unsigned char *)(r + 1);
+    Data *data = makeData((DataType)r->type, bytes, r->size);
+    sync = r->sync != 0;
+    kill(found->second);
+    index.erase(found);
+    hits++;
+    return data;
+  }
+  void erase(int addr) {
+    auto found = index.find(addr);
+    if (found != index.end()) {
+      kill(found->second);
+      index.erase(found);
+    }
+  }
+  bool contains(int addr) { return index.count(addr) > 0; }
+  int getCount() { return (int)index.size(); }
+  size_t getFileBytes() { return segments.size() * segmentBytes; }
+
+  void print(ostream &os) {
+    size_t used = 0, live = 0;
+    for (auto &s : segments) {
+      used += s.second.used;
+      live += s.second.live;
+    }
+    os << "spill entries " << index.size() << " segments " << segments.size()
+       << " bytes " << used << " live " << live << endl;
+    os << "spill stored " << stored << " hits " << hits << " dropped "
+       << dropped << " compactions " << compactions << endl;
+  }
+};
+
+template <class Engine, class Policy>
+void BasicCache<Engine, Policy>::spillTo(SpillTier *s) {
+  delete spill;
+  spill = s;
+}
+
+template <class Engine, class Policy>
+SpillTier *BasicCache<Engine, Policy>::getSpill() {
+  return (SpillTier *)spill; // only spillTo sets it
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+// cheap timestamp for latency recording: the TSC where there is one
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+  return __rdtsc();
+#else
+  return chrono::duration_cast<chrono::nanoseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+double calibrateTicks() {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  uint64_t t0 = ticks();
+  while (chrono::steady_clock::now() - start < chrono::milliseconds(5)) {
+  }
+  uint64_t t1 = ticks();
+  double ns =
+      chrono::duration<double, nano>(chrono::steady_clock::now() - start)
+          .count();
+  return (t1 > t0) ? ns / (t1 - t0) : 1;
+}
+
+// measured once against steady_clock; the static is thread-safe
+double nsPerTick() {
+  static double ratio = calibrateTicks();
+  return ratio;
+}
+
+// index of the highest set bit of v, which must not be 0
+inline int highestBit(uint64_t v) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(v);
+#elif defined(_M_X64)
+  unsigned long e;
+  _BitScanReverse64(&e, v);
+  return (int)e;
+#else
+  int e = 0;
+  while (v >>= 1) {
+    e++;
+  }
+  return e;
+#endif
+}
+
+// index of the lowest set bit of v, which must not be 0
+inline int lowestBit(uint32_t v) {
+#if defined(__GNUC__)
+  return __builtin_ctz(v);
+#elif defined(_MSC_VER)
+  unsigned long e;
+  _BitScanForward(&e, v);
+  return (int)e;
+#else
+  int e = 0;
+  while ((v & 1) == 0) {
+    v >>= 1;
+    e++;
+  }
+  return e;
+#endif
+}
+
+// Log-linear histogram in the style of HdrHistogram: 16 linear buckets per
+// power of two, so a reported value is within 1/16 of the recorded one
+class LatencyHistogram {
+  static const int SUB = 16;
+  static const int BUCKETS = 61 * SUB;
+  uint64_t counts[BUCKETS];
+  uint64_t total, largest;
+
+  static int bucket(uint64_t v) {
+    if (v < (uint64_t)SUB) {
+      return (int)v;
+    }
+    int e = highestBit(v);
+    return (e - 3) * SUB + (int)((v >> (e - 4)) & (SUB - 1));
+  }
+  static uint64_t lowest(int b) {
+    if (b < SUB) {
+      return b;
+    }
+    int e = b / SUB + 3;
+    return (uint64_t)(SUB + b % SUB) << (e - 4);
+  }
+
+public:
+  LatencyHistogram() { reset(); }
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    total = largest = 0;
+  }
+  void record(uint64_t v) {
+    counts[bucket(v)]++;
+    total++;
+    largest = (v > largest) ? v : largest;
+  }
+  void merge(const LatencyHistogram &other) {
+    for (int b = 0; b < BUCKETS; b++) {
+      counts[b] += other.counts[b];
+    }
+    total += other.total;
+    largest = (other.largest > largest) ? other.largest : largest;
+  }
+  uint64_t count() const { return total; }
+  uint64_t max() const { return largest; }
+  uint64_t percentile(double p) const { // 0 <= p <= 100
+    uint64_t rank = (uint64_t)(p / 100 * total), seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+      seen += counts[b];
+      if (counts[b] > 0 && seen > rank) {
+        return lowest(b);
+      }
+    }
+    return largest;
+  }
+};
+
+struct CacheStats {
+  uint64_t reads, readHits, puts, writes, writeHits, evictions,
+      dirtyEvictions, rejected; // rejected: misses the admission kept out
+  uint64_t spillHits;           // read misses the spill tier had
+  LatencyHistogram readLatency, putLatency, writeLatency; // in ticks
+
+  CacheStats() { reset(); }
+  void reset() {
+    reads = readHits = puts = writes = writeHits = 0;
+    evictions = dirtyEvictions = rejected = spillHits = 0;
+    readLatency.reset();
+    putLatency.reset();
+    writeLatency.reset();
+  }
+  double hitRatio() const { return reads ? (double)readHits / reads : 0; }
+  static double ns(uint64_t t) { return t * nsPerTick(); }
+
+  // the counts alone, which do not vary from run to run
+  void printCounts(ostream &os) const {
+    os << "reads " << reads << " hits " << readHits << " misses "
+       << reads - readHits << " hit ratio " << hitRatio() << endl;
+    os << "writes " << writes << " hits " << writeHits << " misses "
+       << writes - writeHits << endl;
+    os << "puts " << puts << " evictions " << evictions << " dirty "
+       << dirtyEvictions << " rejected " << rejected << endl;
+    if (spillHits > 0) {
+      os << "spill hits " << spillHits << endl;
+    }
+  }
+  void print(ostream &os) const {
+    printCounts(os);
+    const char *names[] = {"read", "put", "write"};
+    const LatencyHistogram *hists[] = {&readLatency, &putLatency,
+                                       &writeLatency};
+    for (int i = 0; i < 3; i++) {
+      const LatencyHistogram &h = *hists[i];
+      os << names[i] << " ns p50 " << ns(h.percentile(50)) << " p90 "
+         << ns(h.percentile(90)) << " p99 " << ns(h.percentile(99))
+         << " p99.9 " << ns(h.percentile(99.9)) << " max " << ns(h.max())
+         << endl;
+    }
+  }
+};
+
+// Shape of a search engine at one point in time, filled in by
+// SearchEngine::diagnose. Fields an engine does not have stay zero.
+struct EngineStats {
+  int entries;
+  // hash engines
+  int slots, tombstones; // tombstones: emptied by a delete, not reused yet
+  int missProbes;        // probes a search for an absent key makes
+  uint64_t failedInserts;        // the probe sequence had no free slot
+  vector<uint64_t> probeLengths; // [i]: entries found at probe i + 1
+  // trees
+  int height;
+  double avgDepth; // root at depth 1
+  uint64_t leftRotations, rightRotations;
+
+  EngineStats()
+      : entries(0), slots(0), tombstones(0), missProbes(0), failedInserts(0),
+        height(0), avgDepth(0), leftRotations(0), rightRotations(0) {}
+  double loadFactor() const { return slots ? (double)entries / slots : 0; }
+  double tombstoneRatio() const {
+    return slots ? (double)tombstones / slots : 0;
+  }
+  double avgProbes() const {
+    uint64_t n = 0, sum = 0;
+    for (size_t i = 0; i < probeLengths.size(); i++) {
+      n += probeLengths[i];
+      sum += probeLengths[i] * (i + 1);
+    }
+    return n ? (double)sum / n : 0;
+  }
+
+  void print(ostream &os) const {
+    os << "entries " << entries << endl;
+    if (slots > 0) {
+      os << "slots " << slots << " load factor " << loadFactor()
+         << " tombstones " << tombstones << " tombstone ratio "
+         << tombstoneRatio() << endl;
+      os << "hit probes avg " << avgProbes() << " max "
+         << probeLengths.size() << " miss probes " << missProbes
+         << " failed inserts " << failedInserts << endl;
+      for (size_t i = 0; i < probeLengths.size(); i++) {
+        if (probeLengths[i] > 0) {
+          os << "probes " << i + 1 << ": " << probeLengths[i] << endl;
+        }
+      }
+    } else {
+      os << "height " << height << " avg depth " << avgDepth
+         << " rotations left " << leftRotations << " right "
+         << rightRotations << endl;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// One read from a backing store: the int at byte addr * sizeof(int) of
+// the file. complete is called from AsyncStore::wait on the thread that
+// waits, never from a store thread.
+struct LoadRequest {
+  int addr;
+  int bits;   // the value read
+  bool found; // false past the end of the file or on an I/O error
+  void (*complete)(LoadRequest *);
+};
+
+// Reads loads without blocking the thread that submits them
+class AsyncStore {
+public:
+  virtual ~AsyncStore() {}
+  virtual void submit(LoadRequest *r) = 0;
+  // completes the loads that have finished, waiting for at least one if
+  // block and any are in flight; returns how many it completed
+  virtual int wait(bool block) = 0;
+  virtual int inFlight() = 0;
+  virtual const char *name() = 0;
+};
+
+// io_uring through the raw system calls: submissions gather in the ring
+// and go to the kernel in one io_uring_enter when wait is called, so a
+// thread can keep up to a ring's worth of reads in flight
+class UringStore final : public AsyncStore {
+  int fd, ring;
+  unsigned entries;
+  // submission ring
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  // completion ring
+  unsigned *cqHead, *cqTail, *cqMask;
+  io_uring_cqe *cqes;
+  void *sqMap, *cqMap;
+  io_uring_sqe *sqes;
+  size_t sqMapSize, cqMapSize, sqesSize;
+  unsigned queued;              // in the ring, not yet entered
+  int running;                  // submitted, not completed
+  deque<LoadRequest *> waiting; // past the ring's capacity
+
+  static int enter(int ring, unsigned submit, unsigned complete,
+                   unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring, submit, complete, flags,
+                        nullptr, 0);
+  }
+  void push(LoadRequest *r) {
+    unsigned tail = *sqTail;
+    unsigned i = tail & *sqMask;
+    io_uring_sqe *sqe = &sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)&r->bits;
+    sqe->len = sizeof(r->bits);
+    sqe->off = (uint64_t)r->addr * sizeof(r->bits);
+    sqe->user_data = (uint64_t)(uintptr_t)r;
+    sqArray[i] = i;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+    running++;
+  }
+
+public:
+  UringStore(const string &path, unsigned entries = 256)
+      : ring(-1), entries(entries), sqMap(MAP_FAILED), cqMap(MAP_FAILED),
+        sqes((io_uring_sqe *)MAP_FAILED), sqMapSize(0), cqMapSize(0),
+        sqesSize(0), queued(0), running(0) {
+    fd = open(path.c_str(), O_RDONLY);
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (fd >= 0) {
+      ring = (int)syscall(__NR_io_uring_setup, entries, &p);
+    }
+    if (ring < 0) {
+      return;
+    }
+    this->entries = p.sq_entries;
+    sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    sqes = (io_uring_sqe *)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring,
+                                IORING_OFF_SQES);
+    if (!ok()) {
+      return;
+    }
+    char *sq = (char *)sqMap, *cq = (char *)cqMap;
+    sqHead = (unsigned *)(sq + p.sq_off.head);
+    sqTail = (unsigned *)(sq + p.sq_off.tail);
+    sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    sqArray = (unsigned *)(sq + p.sq_off.array);
+    cqHead = (unsigned *)(cq + p.cq_off.head);
+    cqTail = (unsigned *)(cq + p.cq_off.tail);
+    cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+  }
+  ~UringStore() {
+    if (sqes != MAP_FAILED) {
+      munmap(sqes, sqesSize);
+    }
+    if (cqMap != MAP_FAILED) {
+      munmap(cqMap, cqMapSize);
+    }
+    if (sqMap != MAP_FAILED) {
+      munmap(sqMap, sqMapSize);
+    }
+    if (ring >= 0) {
+      close(ring);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  // false if the kernel has no io_uring or the file cannot be opened
+  bool ok() {
+    return ring >= 0 && sqMap != MAP_FAILED && cqMap != MAP_FAILED &&
+           sqes != MAP_FAILED;
+  }
+  void submit(LoadRequest *r) {
+    if (running < (int)entries) {
+      push(r);
+    } else {
+      waiting.push_back(r);
+    }
+  }
+  int wait(bool block) {
+    if (running == 0) {
+      return 0;
+    }
+    vector<LoadRequest *> done;
+    unsigned head = *cqHead;
+    bool empty = head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (queued > 0 || (block && empty)) {
+      int n = enter(ring, queued, (block && empty) ? 1 : 0,
+                    IORING_ENTER_GETEVENTS);
+      if (n >= 0) {
+        queued -= n;
+      } else if (errno != EINTR) {
+        // the ring is unusable: take back what the kernel has not read
+        // and fail it
+        unsigned first = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        for (unsigned i = first; i != *sqTail; i++) {
+          io_uring_sqe *sqe = &sqes[sqArray[i & *sqMask]];
+          LoadRequest *r = (LoadRequest *)(uintptr_t)sqe->user_data;
+          r->found = false;
+          done.push_back(r);
+        }
+        __atomic_store_n(sqTail, first, __ATOMIC_RELEASE);
+        queued = 0;
+      }
+    }
+    int completed = 0;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      io_uring_cqe *cqe = &cqes[head & *cqMask];
+      LoadRequest *r = (LoadRequest *)(uintptr_t)cqe->user_data;
+      r->found = cqe->res == (int)sizeof(r->bits);
+      done.push_back(r);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    running -= (int)done.size();
+    while (!waiting.empty() && running < (int)entries) {
+      push(waiting.front());
+      waiting.pop_front();
+    }
+    for (LoadRequest *r : done) {
+      r->complete(r); // may submit more
+      completed++;
+    }
+    return completed;
+  }
+  int inFlight() { return running + (int)waiting.size(); }
+  const char *name() { return "io_uring"; }
+};
+
+// pread on a pool of threads; finished loads wait in a queue for wait()
+class ThreadPoolStore final : public AsyncStore {
+  int fd;
+  mutex lock;
+  condition_variable work, finished;
+  deque<LoadRequest *> todo, done;
+  vector<thread> pool;
+  int running; // submitted, not completed
+  bool stopping;
+
+  void run() {
+    unique_lock<mutex> l(lock);
+    while (true) {
+      work.wait(l, [&] { return stopping || !todo.empty(); });
+      if (todo.empty()) {
+        return;
+      }
+      LoadRequest *r = todo.front();
+      todo.pop_front();
+      l.unlock();
+      ssize_t n = pread(fd, &r->bits, sizeof(r->bits),
+                        (off_t)r->addr * sizeof(r->bits));
+      l.lock();
+      r->found = n == (ssize_t)sizeof(r->bits);
+      done.push_back(r);
+      finished.notify_one();
+    }
+  }
+
+public:
+  ThreadPoolStore(const string &path, int threads = 16)
+      : running(0), stopping(false) {
+    fd = open(path.c_str(), O_RDONLY);
+    for (int i = 0; i < threads; i++) {
+      pool.push_back(thread(&ThreadPoolStore::run, this));
+    }
+  }
+  ~ThreadPoolStore() {
+    {
+      lock_guard<mutex> l(lock);
+      stopping = true;
+    }
+    work.notify_all();
+    for (thread &t : pool) {
+      t.join();
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  bool ok() { return fd >= 0; }
+  void submit(LoadRequest *r) {
+    {
+      lock_guard<mutex> l(lock);
+      todo.push_back(r);
+    }
+    running++;
+    work.notify_one();
+  }
+  int wait(bool block) {
+    deque<LoadRequest *> ready;
+    {
+      unique_lock<mutex> l(lock);
+      if (block && running > 0) {
+        finished.wait(l, [&] { return !done.empty(); });
+      }
+      ready.swap(done);
+    }
+    running -= (int)ready.size();
+    for (LoadRequest *r : ready) {
+      r->complete(r);
+    }
+    return (int)ready.size();
+  }
+  int inFlight() { return running; }
+  const char *name() { return "threads"; }
+};
+
+// io_uring where the kernel has it, else the thread pool; nullptr if the
+// file cannot be opened
+AsyncStore *openStore(const string &path, bool uring = true) {
+  if (uring) {
+    UringStore *s = new UringStore(path);
+    if (s->ok()) {
+      return s;
+    }
+    delete s;
+  }
+  ThreadPoolStore *s = new ThreadPoolStore(path);
+  if (s->ok()) {
+    return s;
+  }
+  delete s;
+  return nullptr;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "main.h"
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// One R/U/W operation. The binary trace format is TRACE_MAGIC followed by
+// a packed array of these in native byte order.
+struct TraceRecord {
+  char code; // 'R', 'U' or 'W'
+  char type; // DataType of the value
+  char pad[2];
+  int addr;
+  int bits; // Data::getBits of the value
+};
+
+const char TRACE_MAGIC[8] = "AVLTRC1";
+
+// value text as the trace format writes it: 12, 1.5, true, 7A
+string formatValue(DataType type, int bits) {
+  Data *data = makeData(type, bits);
+  string s = data->getValue();
+  delete data;
+  return s;
+}
+
+bool parseValue(const string &s, DataType &type, int &bits) {
+  if (s == "true" || s == "false") {
+    type = BOOL_DATA;
+    bits = s == "true";
+    return true;
+  }
+  if (s.empty() || isspace((unsigned char)s[0])) {
+    return false;
+  }
+  char *end;
+  if (s.back() == 'A') {
+    type = ADDRESS_DATA;
+    bits = (int)strtol(s.c_str(), &end, 10);
+    return end != s.c_str() && end == s.c_str() + s.size() - 1;
+  }
+  bits = (int)strtol(s.c_str(), &end, 10);
+  if (*end == '\0') {
+    type = INT_DATA;
+    return true;
+  }
+  // as to_string writes a float: no hex forms
+  float f = strtof(s.c_str(), &end);
+  if (*end != '\0' || s.find_first_of("xX") != string::npos) {
+    return false;
+  }
+  type = FLOAT_DATA;
+  memcpy(&bits, &f, sizeof(bits));
+  return true;
+}
+
+// reads the R/U/W operations of a text or binary trace, other commands
+// are skipped; false if the file cannot be opened
+bool readTrace(const string &path, vector<TraceRecord> &ops) {
+  ifstream ifs(path, ios::binary);
+  if (!ifs) {
+    return false;
+  }
+  char magic[sizeof(TRACE_MAGIC)] = {0};
+  ifs.read(magic, sizeof(magic));
+  if (ifs && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+    TraceRecord rec;
+    while (ifs.read((char *)&rec, sizeof(rec))) {
+      ops.push_back(rec);
+    }
+    return true;
+  }
+  ifs.clear();
+  ifs.seekg(0);
+  string line;
+  while (getline(ifs, line)) {
+    stringstream ss(line);
+    string code, value;
+    TraceRecord rec = {0, INT_DATA, {0, 0}, 0, 0};
+    ss >> code;
+    if (code.empty() || (code[0] != 'R' && code[0] != 'U' && code[0] != 'W') ||
+        !(ss >> rec.addr)) {
+      continue;
+    }
+    rec.code = code[0];
+    DataType type = INT_DATA;
+    if (ss >> value && parseValue(value, type, rec.bits)) {
+      rec.type = (char)type;
+    }
+    ops.push_back(rec);
+  }
+  return true;
+}
+
+// YCSB-style zipfian over [0, n) with theta 0.99, scrambled so that the
+// hot keys are spread over the key space
+class Zipf {
+  int n;
+  double theta, alpha, zetan, eta;
+
+public:
+  Zipf(int n, double theta = 0.99) : n(n), theta(theta) {
+    double zeta2 = 1 + pow(0.5, theta);
+    zetan = 0;
+    for (int i = 1; i <= n; i++) {
+      zetan += 1 / pow(i, theta);
+    }
+    alpha = 1 / (1 - theta);
+    eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+  }
+  int next(double u) {
+    double uz = u * zetan;
+    long long rank = 0;
+    if (uz >= 1 + pow(0.5, theta)) {
+      rank = (long long)(n * pow(eta * u - eta + 1, alpha));
+    } else if (uz >= 1) {
+      rank = 1;
+    }
+    return (int)((uint64_t)min<long long>(rank, n - 1) * 2654435761u % n);
+  }
+};
+
+#endif
@@ -0,0 +1,308 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "main.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <condition_variable>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_set>
+#include <unistd.h>
+
+// Append-only log of cache writes. append() only encodes the record into
+// memory; a background thread writes and fdatasyncs everything pending as
+// one group once maxBatch bytes are waiting or the oldest record has
+// waited maxDelay, so a burst of writes pays for one fsync. commit()
+// waits until a record is on disk.
+class WriteAheadLog final : public WriteLog {
+  struct Record { // followed by size bytes
+    uint32_t check; // crc32 of the rest of the record and the bytes
+    int addr;
+    uint32_t size;
+    char type, pad[3];
+  };
+  int fd;
+  chrono::microseconds maxDelay;
+  size_t maxBatch;
+  mutex lock;
+  condition_variable wake, done; // for the flusher, for commit
+  string pending;                // records not written yet
+  chrono::steady_clock::time_point oldest; // of the pending records
+  uint64_t appended, durable;              // records
+  uint64_t groups;
+  bool forced, stopping, failed;
+  thread flusher;
+
+  static uint32_t crc32(const unsigned char *p, size_t n, uint32_t crc) {
+    static uint32_t table[256];
+    static bool ready = [] {
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+          c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+      }
+      return true;
+    }();
+    (void)ready;
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+      crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+  static uint32_t checksum(const Record &r, const unsigned char *bytes) {
+    const unsigned char *head = (const unsigned char *)&r + sizeof(r.check);
+    return crc32(bytes, r.size, crc32(head, sizeof(r) - sizeof(r.check), 0));
+  }
+  static void encode(string &out, int addr, Data *data) {
+    SharedBuffer bytes = data->share();
+    Record r = {0, addr, (uint32_t)bytes.size(), (char)data->getType(),
+                {0, 0, 0}};
+    r.check = checksum(r, bytes.data());
+    out.append((const char *)&r, sizeof(r));
+    out.append((const char *)bytes.data(), bytes.size());
+  }
+  static bool writeAll(int fd, const string &s) {
+    for (size_t off = 0; off < s.size();) {
+      ssize_t n = ::write(fd, s.data() + off, s.size() - off);
+      if (n <= 0) {
+        return false;
+      }
+      off += n;
+    }
+    return true;
+  }
+  void run() {
+    unique_lock<mutex> l(lock);
+    while (true) {
+      wake.wait(l, [&] { return stopping || !pending.empty(); });
+      if (pending.empty()) {
+        break; // stopping with nothing left
+      }
+      wake.wait_until(l, oldest + maxDelay, [&] {
+        return stopping || forced || pending.size() >= maxBatch;
+      });
+      string batch;
+      batch.swap(pending);
+      uint64_t upto = appended;
+      forced = false;
+      l.unlock();
+      bool ok = writeAll(fd, batch) && fdatasync(fd) == 0;
+      l.lock();
+      failed = failed || !ok;
+      durable = upto;
+      groups++;
+      done.notify_all();
+    }
+  }
+
+public:
+  // maxDelay bounds how long a record waits for its group, maxBatch how
+  // many bytes a group gathers before it is written anyway
+  WriteAheadLog(const string &path, int maxDelayUs = 1000,
+                size_t maxBatch = 64 << 10)
+      : maxDelay(maxDelayUs), maxBatch(maxBatch), appended(0), durable(0),
+        groups(0), forced(false), stopping(false), failed(false) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+    failed = fd < 0;
+    if (fd >= 0) {
+      flusher = thread(&WriteAheadLog::run, this);
+    }
+  }
+  ~WriteAheadLog() {
+    if (flusher.joinable()) {
+      {
+        lock_guard<mutex> l(lock);
+        stopping = true;
+      }
+      wake.notify_one();
+      flusher.join();
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  bool ok() {
+    lock_guard<mutex> l(lock);
+    return !failed;
+  }
+  // Logs a write; returns its sequence number for commit, 0 if the log
+  // could not be opened, in which case the record is dropped
+  uint64_t append(int addr, Data *data) {
+    if (fd < 0) {
+      return 0;
+    }
+    string record;
+    encode(record, addr, data);
+    lock_guard<mutex> l(lock);
+    bool first = pending.empty();
+    if (first) {
+      oldest = chrono::steady_clock::now();
+    }
+    pending += record;
+    if (first || pending.size() >= maxBatch) {
+      wake.notify_one();
+    }
+    return ++appended;
+  }
+  // Waits until every record up to lsn is on disk, all of them by default.
+  // False if a write or fsync of the log has failed.
+  bool commit(uint64_t lsn = UINT64_MAX) {
+    unique_lock<mutex> l(lock);
+    lsn = min(lsn, appended);
+    if (durable < lsn && !failed) {
+      forced = true;
+      wake.notify_one();
+      done.wait(l, [&] { return durable >= lsn || failed; });
+    }
+    return !failed;
+  }
+  // Empties the log once the dirty entries it covers are written back
+  bool truncate() {
+    if (!commit()) {
+      return false;
+    }
+    lock_guard<mutex> l(lock);
+    return ftruncate(fd, 0) == 0 && fdatasync(fd) == 0;
+  }
+  uint64_t getAppended() {
+    lock_guard<mutex> l(lock);
+    return appended;
+  }
+  uint64_t getDurable() {
+    lock_guard<mutex> l(lock);
+    return durable;
+  }
+  uint64_t getGroups() { // fsyncs so far
+    lock_guard<mutex> l(lock);
+    return groups;
+  }
+
+  // Calls apply for every whole record of the log at path, oldest first,
+  // and cuts off a torn or corrupt tail. Returns the number of records,
+  // -1 if the file cannot be read. A missing file is an empty log.
+  static int replay(const string &path, function<void(int, Data *)> apply) {
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+      return (errno == ENOENT) ? 0 : -1;
+    }
+    string log;
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+      log.append(chunk, n);
+    }
+    if (n < 0) {
+      close(fd);
+      return -1;
+    }
+    int records = 0;
+    size_t off = 0;
+    while (off + sizeof(Record) <= log.size()) {
+      Record r;
+      memcpy(&r, log.data() + off, sizeof(r));
+      const unsigned char *bytes =
+          (const unsigned char *)log.data() + off + sizeof(r);
+      if (r.size > log.size() - off - sizeof(r) ||
+          checksum(r, bytes) != r.check || r.type < INT_DATA ||
+          r.type > BLOB_DATA) {
+        break;
+      }
+      apply(r.addr, makeData((DataType)r.type, bytes, r.size));
+      off += sizeof(r) + r.size;
+      records++;
+    }
+    if (off < log.size() && ftruncate(fd, off) != 0) {
+      records = -1;
+    }
+    close(fd);
+    return records;
+  }
+  // Replaces the log at path with one record per entry, oldest first. The
+  // records go to a new file that is renamed over the log, so a crash
+  // leaves either log whole. No log may be open on path meanwhile.
+  static bool rewrite(const string &path,
+                      const vector<pair<int, Data *>> &entries) {
+    string tmp = path + ".tmp", out;
+    for (const pair<int, Data *> &e : entries) {
+      encode(out, e.first, e.second);
+    }
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+      return false;
+    }
+    bool ok = writeAll(fd, out) && fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    // the rename is durable once the directory holding the log is
+    size_t slash = path.find_last_of('/');
+    string dir =
+        (slash == string::npos) ? "." : path.substr(0, max(slash, (size_t)1));
+    int dirFd = open(dir.c_str(), O_RDONLY);
+    ok = dirFd >= 0 && fsync(dirFd) == 0;
+    if (dirFd >= 0) {
+      close(dirFd);
+    }
+    return ok;
+  }
+};
+
+template <class Engine, class Policy>
+void BasicCache<Engine, Policy>::logWrites(WriteAheadLog *w) {
+  delete wal;
+  wal = w;
+}
+
+template <class Engine, class Policy>
+WriteAheadLog *BasicCache<Engine, Policy>::getLog() {
+  return (WriteAheadLog *)wal; // only logWrites sets it
+}
+
+template <class Engine, class Policy>
+int BasicCache<Engine, Policy>::recover(const string &path) {
+  WriteLog *attached = wal;
+  wal = nullptr; // the records are in the log already
+  vector<Elem *> victims; // handed to the sink
+  int records = WriteAheadLog::replay(path, [&](int addr, Data *data) {
+    Elem *victim = write(addr, data);
+    if (victim != nullptr && sink != nullptr) {
+      sink->push_back(victim);
+      victims.push_back(victim);
+    } else {
+      delete victim;
+    }
+  });
+  wal = attached;
+  if (records > 0) {
+    // the newest value of each address is enough, and a clean one needs
+    // no record
+    unordered_set<int> seen;
+    vector<pair<int, Data *>> dirty;
+    for (int i = 0; i < rp->getCapacity(); i++) {
+      Elem *e = rp->getValue(i);
+      if (e != nullptr && seen.insert(e->addr).second && !e->sync) {
+        dirty.push_back({e->addr, e->data});
+      }
+    }
+    for (size_t i = victims.size(); i-- > 0;) {
+      Elem *e = victims[i];
+      if (seen.insert(e->addr).second && !e->sync) {
+        dirty.push_back({e->addr, e->data});
+      }
+    }
+    WriteAheadLog::rewrite(path, dirty); // on failure the old log stays
+  }
+  return records;
+}
+
+#endif
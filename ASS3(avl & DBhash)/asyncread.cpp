@@ -0,0 +1,111 @@
+#include "main.h"
+#include "Cache.cpp"
+#include "Cache.h"
+#include "Async.h"
+#include <chrono>
+#include <random>
+
+// Read-through of a file store from one thread with many coroutines, each
+// keeping one read in flight (build with -std=c++20 -pthread):
+//   asyncread [--store PATH] [--entries N] [--capacity N] [--reads N]
+//             [--coroutines N] [--backend uring|threads]
+//             [--admission doorkeeper|tinylfu]
+// The store holds the int 3 * addr + 1 at every addr below --entries; it
+// is created at PATH if it is not there. Every value read is checked, and
+// the exit status is 1 if any was wrong. A tiny cache evicts what a load
+// just put before its waiters resume, which makes a good check under
+// -fsanitize=address, and with --admission a load is often not admitted:
+//   asyncread --capacity 2 --entries 1000 --reads 20000 --coroutines 64
+
+Task reader(AsyncCache &cache, vector<int> &addrs, size_t &next,
+            long long &wrong) {
+  while (next < addrs.size()) {
+    int addr = addrs[next++];
+    Data *data = co_await cache.readAsync(addr);
+    if (data == nullptr || data->getBits() != 3 * addr + 1) {
+      wrong++;
+    }
+    delete data;
+  }
+}
+
+bool makeStore(const string &path, int entries) {
+  ifstream existing(path, ios::binary | ios::ate);
+  if (existing && existing.tellg() == (streamoff)(entries * sizeof(int))) {
+    return true;
+  }
+  vector<int> values(entries);
+  for (int i = 0; i < entries; i++) {
+    values[i] = 3 * i + 1;
+  }
+  ofstream ofs(path, ios::binary | ios::trunc);
+  ofs.write((const char *)values.data(), values.size() * sizeof(int));
+  return ofs.good();
+}
+
+int main(int argc, char *argv[]) {
+  string path = "/tmp/asyncread.store", backend = "uring", admission;
+  int entries = 1 << 20, capacity = 1 << 14, coroutines = 256;
+  long long reads = 1 << 20;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    string flag = argv[i], value = argv[i + 1];
+    if (flag == "--store") {
+      path = value;
+    } else if (flag == "--entries") {
+      entries = stoi(value);
+    } else if (flag == "--capacity") {
+      capacity = stoi(value);
+    } else if (flag == "--reads") {
+      reads = stoll(value);
+    } else if (flag == "--coroutines") {
+      coroutines = stoi(value);
+    } else if (flag == "--backend") {
+      backend = value;
+    } else if (flag == "--admission") {
+      admission = value;
+    } else {
+      cerr << "unknown flag " << flag << endl;
+      return 1;
+    }
+  }
+  if (!makeStore(path, entries)) {
+    cerr << "cannot write store " << path << endl;
+    return 1;
+  }
+  AsyncStore *store = openStore(path, backend == "uring");
+  if (store == nullptr) {
+    cerr << "cannot open store " << path << endl;
+    return 1;
+  }
+  vector<int> addrs(reads);
+  mt19937 rng(1);
+  for (int &a : addrs) {
+    a = (int)(rng() % entries);
+  }
+  Cache cache(new AVL(), makePolicy("LRU", capacity));
+  cache.setAdmission(makeAdmission(admission, capacity));
+  Executor exec(store);
+  size_t next = 0;
+  long long wrong = 0;
+  {
+    AsyncCache async(&cache, exec);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < coroutines; i++) {
+      exec.spawn(reader(async, addrs, next, wrong));
+    }
+    exec.run();
+    double seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    const CacheStats &s = cache.getStats();
+    cout << "backend " << store->name() << " coroutines " << coroutines
+         << endl;
+    cout << "reads " << reads << " in " << seconds << " s, "
+         << reads / seconds << " reads/s" << endl;
+    cout << "cache hit ratio " << s.hitRatio() << " loads "
+         << async.getLoads() << " shared " << async.getSharedLoads()
+         << " peak in flight " << async.getPeakInFlight() << endl;
+    cout << "wrong values " << wrong << endl;
+  }
+  delete store;
+  return wrong > 0;
+}
@@ -0,0 +1,371 @@
+#include "main.h"
+#include "Cache.cpp"
+#include "Cache.h"
+#include "Trace.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// Throughput and latency of every engine x policy pair:
+//   bench [--min-capacity N] [--max-capacity N] [--time SECONDS]
+//         [--engines AVL,ART,DBHashing,Cuckoo] [--policies FIFO,LRU,MRU,LFU]
+//         [--distributions uniform,zipf,scan] [--format console|csv|json]
+// Capacity grows 16x per step from 16 to 10M. Virtual Cache vs
+// statically composed BasicCache on a hit-heavy mix:
+//   bench --compare [capacity] [operations]
+// Latency of each put while a DBHashing table grows from 61 slots to hold
+// entries, rehashing all at once vs step slots per operation:
+//   bench --grow [entries] [step]
+// Searches and changes per second of 1, 2, 4 ... threads sharing one
+// engine, Cuckoo against DBHashing behind a mutex:
+//   bench --threads [max threads] [entries] [seconds]
+
+typedef chrono::steady_clock Clock;
+
+// a cyclic buffer of pre-generated keys in [offset, offset + n)
+class KeyStream {
+  vector<int> keys;
+  size_t pos;
+
+public:
+  KeyStream(const string &dist, int n, int offset, unsigned seed) : pos(0) {
+    mt19937 rng(seed);
+    uniform_real_distribution<double> unit(0, 1);
+    Zipf *zipf = (dist == "zipf") ? new Zipf(n) : nullptr;
+    keys.resize(1 << 16);
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (dist == "scan") {
+        keys[i] = offset + (int)(i % n);
+      } else if (zipf != nullptr) {
+        keys[i] = offset + zipf->next(unit(rng));
+      } else {
+        keys[i] = offset + (int)(rng() % n);
+      }
+    }
+    delete zipf;
+  }
+  int next() {
+    int key = keys[pos];
+    pos = (pos + 1) & (keys.size() - 1);
+    return key;
+  }
+};
+
+struct Result {
+  string engine, policy, distribution, op;
+  int capacity;
+  long long ops;
+  double seconds, p50, p99, p999, max;
+};
+
+// runs op until budget seconds have passed, and at least once, timing
+// every call; the latencies include the two clock reads around it
+Result measure(const function<void()> &op, double budget) {
+  const size_t MAX_SAMPLES = 1 << 22;
+  vector<double> lat;
+  Result r;
+  r.ops = 0;
+  Clock::time_point start = Clock::now(), now = start;
+  while (r.ops == 0 ||
+         chrono::duration<double>(now - start).count() < budget) {
+    Clock::time_point t0 = Clock::now();
+    op();
+    now = Clock::now();
+    if (lat.size() < MAX_SAMPLES) {
+      lat.push_back(chrono::duration<double, nano>(now - t0).count());
+    }
+    r.ops++;
+  }
+  r.seconds = chrono::duration<double>(now - start).count();
+  sort(lat.begin(), lat.end());
+  r.p50 = lat[lat.size() / 2];
+  r.p99 = lat[lat.size() * 99 / 100];
+  r.p999 = lat[lat.size() * 999 / 1000];
+  r.max = lat.back();
+  return r;
+}
+
+vector<string> split(const string &s) {
+  vector<string> out;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ',')) {
+    out.push_back(item);
+  }
+  return out;
+}
+
+void report(const vector<Result> &results, const string &format) {
+  if (format == "json") {
+    cout << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      cout << (i ? "," : "") << "\n    {\"name\": \"" << r.op << "/"
+           << r.engine << "/" << r.policy << "/" << r.distribution << "/"
+           << r.capacity << "\", \"op\": \"" << r.op << "\", \"engine\": \""
+           << r.engine << "\", \"policy\": \"" << r.policy
+           << "\", \"distribution\": \"" << r.distribution
+           << "\", \"capacity\": " << r.capacity
+           << ", \"iterations\": " << r.ops
+           << ", \"ns_per_op\": " << r.seconds * 1e9 / r.ops
+           << ", \"ops_per_sec\": " << r.ops / r.seconds
+           << ", \"p50_ns\": " << r.p50 << ", \"p99_ns\": " << r.p99
+           << ", \"p999_ns\": " << r.p999 << ", \"max_ns\": " << r.max
+           << "}";
+    }
+    cout << "\n  ]\n}" << endl;
+    return;
+  }
+  const char *sep = (format == "csv") ? "," : "\t";
+  cout << "op" << sep << "engine" << sep << "policy" << sep << "distribution"
+       << sep << "capacity" << sep << "iterations" << sep << "ns_per_op"
+       << sep << "ops_per_sec" << sep << "p50_ns" << sep << "p99_ns" << sep
+       << "p999_ns" << sep << "max_ns" << endl;
+  for (const Result &r : results) {
+    cout << r.op << sep << r.engine << sep << r.policy << sep
+         << r.distribution << sep << r.capacity << sep << r.ops << sep
+         << r.seconds * 1e9 / r.ops << sep << r.ops / r.seconds << sep
+         << r.p50 << sep << r.p99 << sep << r.p999 << sep << r.max << endl;
+  }
+}
+
+void suite(int minCapacity, int maxCapacity, double budget,
+           const vector<string> &engines, const vector<string> &policies,
+           const vector<string> &distributions, const string &format) {
+  vector<Result> results;
+  for (int capacity = minCapacity; capacity <= maxCapacity;
+       capacity = (capacity > maxCapacity / 16 && capacity < maxCapacity)
+                      ? maxCapacity
+                      : capacity * 16) {
+    MAXSIZE = capacity;
+    for (const string &engine : engines) {
+      for (const string &policy : policies) {
+        Cache c(makeEngine(engine, capacity), makePolicy(policy, capacity));
+        vector<int> addr(capacity);
+        vector<Data *> cont(capacity);
+        for (int i = 0; i < capacity; i++) {
+          addr[i] = i;
+          cont[i] = new Int(i);
+        }
+        c.putMany(addr.data(), cont.data(), capacity);
+        auto record = [&](Result r, const string &dist, const string &op) {
+          r.engine = engine;
+          r.policy = policy;
+          r.distribution = dist;
+          r.op = op;
+          r.capacity = capacity;
+          results.push_back(r);
+          cerr << op << "/" << engine << "/" << policy << "/" << dist << "/"
+               << capacity << endl;
+        };
+        // reads leave the contents alone, so they all run on the warm cache
+        for (size_t d = 0; d < distributions.size(); d++) {
+          const string &dist = distributions[d];
+          KeyStream hits(dist, capacity, 0, d + 1);
+          KeyStream misses(dist, capacity, 1 << 30, d + 1);
+          record(measure([&] { c.read(hits.next()); }, budget), dist,
+                 "read_hit");
+          record(measure([&] { c.read(misses.next()); }, budget), dist,
+                 "read_miss");
+        }
+        for (size_t d = 0; d < distributions.size(); d++) {
+          const string &dist = distributions[d];
+          KeyStream mixed(dist, 2 * capacity, 0, d + 1);
+          KeyStream fresh(dist, capacity, 1 << 29, d + 1);
+          int value = 0;
+          auto write = [&] { delete c.write(mixed.next(), new Int(value++)); };
+          auto put = [&] { delete c.put(fresh.next(), new Int(value++)); };
+          record(measure(write, budget), dist, "write");
+          record(measure(put, budget), dist, "put");
+        }
+      }
+    }
+  }
+  report(results, format);
+}
+
+typedef StaticDBHashing<h1, h3> Hash13;
+
+template <class C> double run(C &c, const vector<int> &keys, int ops) {
+  for (int i = 0; i < MAXSIZE; i++) {
+    c.put(i, new Int(i));
+  }
+  long long sum = 0;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < ops; i++) {
+    int addr = keys[i % keys.size()];
+    if (i % 8 == 0) {
+      delete c.write(addr, new Int(i));
+    } else {
+      sum += c.read(addr) != nullptr;
+    }
+  }
+  Clock::time_point end = Clock::now();
+  if (sum < 0) {
+    cout << sum << endl; // keeps the reads alive
+  }
+  return chrono::duration<double, nano>(end - start).count() / ops;
+}
+
+template <class Engine, class Policy>
+void compare(const string &name, Engine *(*makeEngine)(),
+             const vector<int> &keys, int ops) {
+  Cache dynamic(makeEngine(), new Policy());
+  BasicCache<Engine, Policy> composed(makeEngine(), new Policy());
+  double d = run(dynamic, keys, ops);
+  double s = run(composed, keys, ops);
+  cout << name << "\t" << d << "\t" << s << "\t" << d / s << endl;
+}
+
+AVL *makeAVL() { return new AVL(); }
+Hash13 *makeHash13() { return new Hash13(2 * MAXSIZE); }
+
+void compareAll(int capacity, int ops) {
+  MAXSIZE = capacity;
+  vector<int> keys(1 << 16);
+  srand(1);
+  for (size_t i = 0; i < keys.size(); i++) {
+    keys[i] = rand() % MAXSIZE;
+  }
+  cout << "engine/policy\tCache ns/op\tBasicCache ns/op\tspeedup" << endl;
+  compare<Hash13, FIFO>("DBHashing/FIFO", makeHash13, keys, ops);
+  compare<AVL, FIFO>("AVL/FIFO", makeAVL, keys, ops);
+  compare<Hash13, LFU>("DBHashing/LFU", makeHash13, keys, ops);
+  compare<AVL, LRU>("AVL/LRU", makeAVL, keys, ops);
+}
+
+// times every put into a cache that starts with a small table
+void growth(int entries, int step) {
+  if (entries < 1) {
+    return; // no latencies to rank
+  }
+  Cache c(makeDBHashing('1', '2', 61), new FIFO(entries));
+  c.setEngineGrowth(0.5, step);
+  vector<double> lat(entries);
+  for (int i = 0; i < entries; i++) {
+    Clock::time_point t0 = Clock::now();
+    delete c.put(i, new Int(i));
+    lat[i] = chrono::duration<double, nano>(Clock::now() - t0).count();
+  }
+  double total = accumulate(lat.begin(), lat.end(), 0.0);
+  sort(lat.begin(), lat.end());
+  EngineStats stats = c.getDiagnostics();
+  cout << ((step > 0) ? "step " + to_string(step) : "all at once") << "\t"
+       << total / entries << "\t" << lat[entries / 2] << "\t"
+       << lat[entries * 99 / 100] << "\t" << lat[entries * 999 / 1000]
+       << "\t" << lat.back() << "\t" << stats.slots << endl;
+}
+
+// Each thread searches random keys of the lower half, which nothing
+// changes, and one time in ten deletes and reinserts one of its own in the
+// upper half, so no two threads change the same key. A search that misses
+// is counted and reported once the timing is over. Returns millions of
+// operations per second.
+double hammer(SearchEngine *s, bool locked, int threads, int entries,
+              double seconds) {
+  mutex m;
+  atomic<bool> stop(false);
+  vector<long long> done(threads), lost(threads);
+  int stable = max(entries / 2, 1); // keys below are never deleted
+  for (int i = 0; i < entries; i++) {
+    Elem e(i, nullptr, true);
+    s->insert(&e, i);
+  }
+  auto work = [&](int t) {
+    mt19937 rng(t + 1);
+    long long ops = 0, misses = 0;
+    for (int own = stable + t; !stop.load(memory_order_relaxed); ops++) {
+      int key = (int)(rng() % stable);
+      unique_lock<mutex> guard(m, defer_lock);
+      if (locked) {
+        guard.lock();
+      }
+      if (ops % 10 != 9) {
+        misses += s->search(key) != key;
+        continue;
+      }
+      Elem e(own, nullptr, true);
+      s->deleteNode(&e);
+      s->insert(&e, own);
+      own = (own + threads < entries) ? own + threads : stable + t;
+    }
+    done[t] = ops;
+    lost[t] = misses;
+  };
+  vector<thread> pool;
+  Clock::time_point start = Clock::now();
+  for (int t = 0; t < threads; t++) {
+    pool.emplace_back(work, t);
+  }
+  this_thread::sleep_for(chrono::duration<double>(seconds));
+  stop = true;
+  for (thread &t : pool) {
+    t.join();
+  }
+  double elapsed = chrono::duration<double>(Clock::now() - start).count();
+  long long missed = accumulate(lost.begin(), lost.end(), 0LL);
+  if (missed > 0) {
+    cerr << "lost " << missed << " searches of keys never deleted" << endl;
+  }
+  return accumulate(done.begin(), done.end(), 0LL) / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && string(argv[1]) == "--threads") {
+    int maxThreads = (argc > 2) ? atoi(argv[2]) : 8;
+    int entries = (argc > 3) ? atoi(argv[3]) : 1000000;
+    double seconds = (argc > 4) ? atof(argv[4]) : 1;
+    cout << "threads\tCuckoo Mops/s\tDBHashing+mutex Mops/s" << endl;
+    for (int t = 1; t <= maxThreads; t *= 2) {
+      SearchEngine *cuckoo = makeEngine("Cuckoo", entries);
+      SearchEngine *hash = makeEngine("DBHashing", entries);
+      cout << t << "\t" << hammer(cuckoo, false, t, entries, seconds) << "\t"
+           << hammer(hash, true, t, entries, seconds) << endl;
+      delete cuckoo;
+      delete hash;
+    }
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "--grow") {
+    int entries = (argc > 2) ? atoi(argv[2]) : 1000000;
+    cout << "rehash\tmean ns\tp50\tp99\tp999\tmax\tslots" << endl;
+    growth(entries, 0);
+    growth(entries, (argc > 3) ? atoi(argv[3]) : 8);
+    return 0;
+  }
+  if (argc > 1 && string(argv[1]) == "--compare") {
+    compareAll((argc > 2) ? atoi(argv[2]) : 64,
+               (argc > 3) ? atoi(argv[3]) : 10000000);
+    return 0;
+  }
+  int minCapacity = 16, maxCapacity = 10000000;
+  double budget = 0.2;
+  string engines = "AVL,ART,DBHashing,Cuckoo", policies = "FIFO,LRU,MRU,LFU";
+  string distributions = "uniform,zipf,scan", format = "console";
+  for (int i = 1; i + 1 < argc; i += 2) {
+    string flag = argv[i], value = argv[i + 1];
+    if (flag == "--min-capacity") {
+      minCapacity = stoi(value);
+    } else if (flag == "--max-capacity") {
+      maxCapacity = stoi(value);
+    } else if (flag == "--time") {
+      budget = stod(value);
+    } else if (flag == "--engines") {
+      engines = value;
+    } else if (flag == "--policies") {
+      policies = value;
+    } else if (flag == "--distributions") {
+      distributions = value;
+    } else if (flag == "--format") {
+      format = value;
+    } else {
+      cerr << "unknown flag " << flag << endl;
+      return 1;
+    }
+  }
+  suite(minCapacity, maxCapacity, budget, split(engines), split(policies),
+        split(distributions), format);
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include "Client.h"
+#include "Trace.h"
+#include <chrono>
+#include <random>
+#include <thread>
+
+// Load on a running cache server from several client threads:
+//   loadtest [--socket PATH] [--clients N] [--depth N] [--seconds S]
+//            [--keys N] [--writes PERCENT] [--distribution uniform|zipf]
+// Each client sends --depth requests, flushes them in one write and reads
+// the replies; a read that misses is followed by a put of the address,
+// as the R trace operation does. Latency is per batch round trip.
+
+struct ClientResult {
+  long long requests, reads, hits;
+  LatencyHistogram batches; // ns
+  bool failed;
+};
+
+void drive(const string &path, int depth, double seconds, int keys,
+           int writes, const string &dist, unsigned seed, ClientResult &r) {
+  r.requests = r.reads = r.hits = 0;
+  r.failed = false;
+  CacheClient client;
+  if (!client.connect(path)) {
+    r.failed = true;
+    return;
+  }
+  mt19937 rng(seed);
+  uniform_real_distribution<double> unit(0, 1);
+  Zipf *zipf = (dist == "zipf") ? new Zipf(keys) : nullptr;
+  vector<int> addrs(depth), misses;
+  vector<char> ops(depth);
+  chrono::steady_clock::time_point end =
+      chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<double>(seconds));
+  while (chrono::steady_clock::now() < end) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < depth; i++) {
+      addrs[i] = zipf ? zipf->next(unit(rng)) : (int)(rng() % keys);
+      ops[i] = ((int)(rng() % 100) < writes) ? OP_WRITE : OP_READ;
+      client.send(ops[i], addrs[i],
+                  (ops[i] == OP_WRITE) ? new Int(addrs[i]) : nullptr);
+    }
+    misses.clear();
+    Reply reply;
+    bool ok = client.flush();
+    for (int i = 0; ok && i < depth; i++) {
+      ok = client.receive(reply);
+      if (ok && ops[i] == OP_READ) {
+        r.reads++;
+        r.hits += reply.status == REPLY_HIT;
+        if (reply.status == REPLY_MISS) {
+          misses.push_back(addrs[i]);
+        }
+      }
+      delete reply.data;
+    }
+    for (int addr : misses) {
+      client.send(OP_PUT, addr, new Int(addr));
+    }
+    ok = ok && client.flush();
+    for (size_t i = 0; ok && i < misses.size(); i++) {
+      ok = client.receive(reply);
+      delete reply.data;
+    }
+    if (!ok) {
+      r.failed = true;
+      break;
+    }
+    r.requests += depth + misses.size();
+    r.batches.record(chrono::duration_cast<chrono::nanoseconds>(
+                         chrono::steady_clock::now() - start)
+                         .count());
+  }
+  delete zipf;
+}
+
+int main(int argc, char *argv[]) {
+  string path = "/tmp/avlcache.sock", dist = "zipf";
+  int clients = 4, depth = 32, keys = 1 << 20, writes = 10;
+  double seconds = 5;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    string flag = argv[i], value = argv[i + 1];
+    if (flag == "--socket") {
+      path = value;
+    } else if (flag == "--clients") {
+      clients = stoi(value);
+    } else if (flag == "--depth") {
+      depth = max(1, stoi(value));
+    } else if (flag == "--seconds") {
+      seconds = stod(value);
+    } else if (flag == "--keys") {
+      keys = stoi(value);
+    } else if (flag == "--writes") {
+      writes = stoi(value);
+    } else if (flag == "--distribution") {
+      dist = value;
+    } else {
+      cerr << "unknown flag " << flag << endl;
+      return 1;
+    }
+  }
+  vector<ClientResult> results(clients);
+  vector<thread> pool;
+  for (int i = 0; i < clients; i++) {
+    pool.push_back(thread(drive, path, depth, seconds, keys, writes, dist,
+                          (unsigned)i + 1, ref(results[i])));
+  }
+  for (thread &t : pool) {
+    t.join();
+  }
+  long long requests = 0, reads = 0, hits = 0;
+  LatencyHistogram batches;
+  int failed = 0;
+  for (ClientResult &r : results) {
+    requests += r.requests;
+    reads += r.reads;
+    hits += r.hits;
+    failed += r.failed;
+    batches.merge(r.batches);
+  }
+  cout << clients << " clients, depth " << depth << ", " << dist << " over "
+       << keys << " keys, " << writes << "% writes" << endl;
+  cout << requests << " requests, " << requests / seconds << " per second"
+       << endl;
+  cout << "read hit ratio " << (reads ? (double)hits / reads : 0) << endl;
+  cout << "batch us p50 " << batches.percentile(50) / 1e3 << " p99 "
+       << batches.percentile(99) / 1e3 << " p99.9 "
+       << batches.percentile(99.9) / 1e3 << " max " << batches.max() / 1e3
+       << endl;
+  if (failed > 0) {
+    cout << failed << " clients lost the server" << endl;
+  }
+  return failed > 0;
+}
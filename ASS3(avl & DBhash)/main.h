@@ -1,20 +1,45 @@
 #ifndef MAIN_H
 #define MAIN_H
+#include "Admission.h"
+#include "Buffer.h"
+#include "Shards.h"
+#include "Stats.h"
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 class ReplacementPolicy;
 class SearchEngine;
+class SpillTier;
+class WriteAheadLog;
 
 using namespace std;
 int MAXSIZE = 5;
 
+enum DataType {
+  INT_DATA,
+  FLOAT_DATA,
+  BOOL_DATA,
+  ADDRESS_DATA,
+  STRING_DATA,
+  BLOB_DATA
+};
+
 class Data {
 public:
   virtual ~Data() = default;
   virtual string getValue() = 0;
+  virtual DataType getType() = 0;
+  virtual int getBits() = 0; // raw payload, inverse of makeData
+  virtual size_t getSize() { return sizeof(int); } // payload bytes
+  // the payload as shared bytes: the raw bits of a fixed-size value
+  virtual SharedBuffer share() {
+    int bits = getBits();
+    return SharedBuffer(&bits, getSize());
+  }
 };
 
 class Int : public Data {
@@ -23,6 +48,8 @@ class Int : public Data {
 public:
   Int(int v) : value(v) {}
   string getValue() { return to_string(value); }
+  DataType getType() { return INT_DATA; }
+  int getBits() { return value; }
 };
 class Float : public Data {
   float value;
@@ -30,6 +57,12 @@ class Float : public Data {
 public:
   Float(float v) : value(v) {}
   string getValue() { return to_string(value); }
+  DataType getType() { return FLOAT_DATA; }
+  int getBits() {
+    int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
 };
 class Bool : public Data {
   bool value;
@@ -37,6 +70,9 @@ class Bool : public Data {
 public:
   Bool(bool v) : value(v) {}
   string getValue() { return value ? "true" : "false"; }
+  DataType getType() { return BOOL_DATA; }
+  int getBits() { return value; }
+  size_t getSize() { return sizeof(bool); }
 };
 class Address : public Data {
   int value;
@@ -44,7 +80,78 @@ class Address : public Data {
 public:
   Address(int v) : value(v) {}
   string getValue() { return to_string(value) + "A"; }
+  DataType getType() { return ADDRESS_DATA; }
+  int getBits() { return value; }
+};
+// Variable-size values. They do not fit in getBits, so snapshots and
+// binary traces cannot carry them. The bytes are a SharedBuffer, so
+// share() hands them out without a copy and a buffer moved in is kept
+// as it is.
+class String : public Data {
+  SharedBuffer value;
+
+public:
+  String(const string &v) : value(v) {}
+  String(SharedBuffer &&v) : value(move(v)) {}
+  string getValue() { return value.str(); }
+  DataType getType() { return STRING_DATA; }
+  int getBits() { return 0; }
+  size_t getSize() { return value.size(); }
+  SharedBuffer share() { return value; }
 };
+class Blob : public Data {
+  SharedBuffer value;
+
+public:
+  Blob(const unsigned char *bytes, size_t n) : value(bytes, n) {}
+  Blob(SharedBuffer &&v) : value(move(v)) {}
+  string getValue() { // 0x and two hex digits per byte
+    static const char digits[] = "0123456789abcdef";
+    string s = "0x";
+    s.reserve(2 + 2 * value.size());
+    const unsigned char *b = value.data();
+    for (size_t i = 0; i < value.size(); i++) {
+      s += digits[b[i] >> 4];
+      s += digits[b[i] & 15];
+    }
+    return s;
+  }
+  DataType getType() { return BLOB_DATA; }
+  int getBits() { return 0; }
+  size_t getSize() { return value.size(); }
+  SharedBuffer share() { return value; }
+  const unsigned char *bytes() { return value.data(); }
+};
+
+Data *makeData(DataType type, int bits) {
+  float fvalue;
+  switch (type) {
+  case INT_DATA:
+    return new Int(bits);
+  case FLOAT_DATA:
+    memcpy(&fvalue, &bits, sizeof(fvalue));
+    return new Float(fvalue);
+  case BOOL_DATA:
+    return new Bool(bits != 0);
+  case ADDRESS_DATA:
+    return new Address(bits);
+  default:
+    break;
+  }
+  return nullptr;
+}
+
+// inverse of Data::share
+Data *makeData(DataType type, const unsigned char *bytes, size_t n) {
+  if (type == STRING_DATA) {
+    return new String(SharedBuffer(bytes, n));
+  } else if (type == BLOB_DATA) {
+    return new Blob(bytes, n);
+  }
+  int bits = 0;
+  memcpy(&bits, bytes, min(n, sizeof(bits)));
+  return makeData(type, bits);
+}
 
 class Elem {
 public:
@@ -53,24 +160,178 @@ public:
   bool sync;
   Elem(int a, Data *d, bool s) : addr(a), data(d), sync(s) {}
   ~Elem() { delete data; }
-  void print() {
-    cout << addr << " " << data->getValue() << " " << (sync ? "true" : "false")
+  void print(ostream &os) {
+    os << addr << " " << data->getValue() << " " << (sync ? "true" : "false")
          << endl;
   }
 };
 
-class Cache {
-  ReplacementPolicy *rp;
-  SearchEngine *s_engine;
+// Where evicted values go when the cache has a second tier: SpillTier in
+// Spill.h. The cache sees only this, so it builds without Spill.h, which
+// needs POSIX.
+class SecondTier {
+public:
+  virtual ~SecondTier() {}
+  virtual bool store(int addr, Data *data, bool sync) = 0;
+  virtual Data *take(int addr, bool &sync) = 0; // nullptr if absent
+  virtual void erase(int addr) = 0;
+};
 
+// Where writes are logged when the cache has a log: WriteAheadLog in
+// Wal.h, kept out of the core for the same reason. append returns the
+// record's sequence number.
+class WriteLog {
 public:
-  Cache(SearchEngine *s, ReplacementPolicy *r);
-  ~Cache();
+  virtual ~WriteLog() {}
+  virtual uint64_t append(int addr, Data *data) = 0;
+};
+
+// read/put/write over any engine and policy. With final classes such as
+// BasicCache<AVL, LRU> every call on these paths is direct and inlinable.
+template <class Engine, class Policy> class BasicCache {
+protected:
+  Policy *rp;
+  Engine *s_engine;
+  CacheStats counters; // plain fields: a cache is driven by one thread
+  Shards *mrc;         // fed every read address when set
+  AdmissionPolicy *admission; // asked before a miss evicts, if set
+  size_t budget, used;        // bytes; budget 0 bounds entries instead
+  vector<Elem *> *sink;       // takes extra victims of a byte-budget miss
+  SecondTier *spill;          // keeps what is evicted, if set
+  WriteLog *wal;              // logs every write, if set
+  // the last operation was a read miss of missedAddr: a put of it now is
+  // the fill of that read and is not recorded again for admission
+  bool missPending;
+  int missedAddr;
+  uint64_t lsn; // of the last write logged, 0 if none
+
+  // false if a miss must not evict for addr, whose entry takes need bytes
+  bool admits(int addr, size_t need);
+  Elem *insert(int addr, Data *cont, bool sync, size_t need);
+  Elem *makeRoom(size_t need, int keep);
+  void shrinkSlots(int n);
+  Data *promote(int addr);
+  void evicted(Elem *victim); // counts it and hands it to the spill tier
+
+public:
+  BasicCache(Engine *s, Policy *r)
+      : rp(r), s_engine(s), mrc(nullptr), admission(nullptr), budget(0),
+        used(0), sink(nullptr), spill(nullptr), wal(nullptr),
+        missPending(false), missedAddr(0), lsn(0) {}
+  ~BasicCache() {
+    delete rp;
+    delete s_engine;
+    delete mrc;
+    delete admission;
+    delete spill;
+    delete wal;
+  }
   Data *read(int addr);
   Elem *put(int addr, Data *cont);
   Elem *write(int addr, Data *cont);
-  void printRP();
-  void printSE();
+  // Zero-copy variants. readShared fills out with the value's bytes, which
+  // stay valid after the entry is evicted; false on a miss. The buffer
+  // writeShared takes is stored as a Blob without copying its bytes.
+  bool readShared(int addr, SharedBuffer &out) {
+    Data *data = read(addr);
+    if (data == nullptr) {
+      return false;
+    }
+    out = data->share();
+    return true;
+  }
+  Elem *writeShared(int addr, SharedBuffer &&value) {
+    return write(addr, new Blob(move(value)));
+  }
+  void printRP(ostream &os = cout) { rp->print(os); }
+  void printSE(ostream &os = cout) { s_engine->print(rp, os); }
+  const CacheStats &getStats() { return counters; }
+  void resetStats() { counters.reset(); }
+  void printStats(ostream &os = cout) { counters.print(os); }
+  void printCounts(ostream &os = cout) { counters.printCounts(os); }
+  EngineStats getDiagnostics() {
+    EngineStats out;
+    s_engine->diagnose(out);
+    return out;
+  }
+  void printDiagnostics(ostream &os = cout) { getDiagnostics().print(os); }
+  void trackMissRatio(Shards *s) { // takes ownership
+    delete mrc;
+    mrc = s;
+  }
+  Shards *getMissRatio() { return mrc; }
+  void setAdmission(AdmissionPolicy *a) { // takes ownership, nullptr: none
+    delete admission;
+    admission = a;
+  }
+  // Bounds the cache by the bytes of its entries instead of their number.
+  // A miss then evicts as many entries as it takes to fit; put and write
+  // return the first victim and hand the rest to the sink, if there is
+  // one. Only while the cache is empty.
+  bool setByteBudget(size_t bytes) {
+    if (!rp->isEmpty() || bytes == 0) {
+      return false;
+    }
+    budget = bytes;
+    rp->setDynamic();
+    return true;
+  }
+  // The engine grows once more than maxLoad of it is used, moving step
+  // of its old slots per operation instead of all at once. False if the
+  // engine has a fixed size.
+  bool setEngineGrowth(double maxLoad, int step = 8) {
+    return s_engine->setGrowth(maxLoad, step);
+  }
+  // The entries with addresses in [lo, hi] in address order, still the
+  // cache's; they do not count as reads. False if the engine keeps no
+  // order.
+  bool scan(int lo, int hi, vector<Elem *> &out) {
+    vector<int> idx;
+    if (!s_engine->scan(lo, hi, idx)) {
+      return false;
+    }
+    for (int i : idx) {
+      out.push_back(rp->getValue(i));
+    }
+    return true;
+  }
+  size_t getByteBudget() { return budget; }
+  size_t getUsedBytes() { return used; }
+  void collectEvictions(vector<Elem *> *s) { sink = s; } // caller owns them
+  // Evicted values are copied to the spill tier, and a read that misses
+  // takes its value back from there into the cache. Victims are still
+  // returned as before. Takes ownership, nullptr: none. In Spill.h.
+  void spillTo(SpillTier *s);
+  SpillTier *getSpill();
+  // Every write is appended to the log before it changes the cache; the
+  // log group-commits them in the background. Takes ownership. In Wal.h,
+  // as are getLog and recover.
+  void logWrites(WriteAheadLog *w);
+  WriteAheadLog *getLog();
+  // sequence number of the last write logged, for getLog()->commit
+  uint64_t getLastLsn() { return lsn; }
+  // Replays the log at path as writes, leaving its entries dirty, then
+  // rewrites it to hold only what is still dirty: the cache's entries and
+  // the victims handed to the sink. Attach the log for path after this.
+  // Returns the records replayed, -1 if the log cannot be read.
+  int recover(const string &path);
+  static size_t entrySize(Data *data) { // address plus value
+    return sizeof(int) + ((data != nullptr) ? data->getSize() : 0);
+  }
+};
+
+class Cache : public BasicCache<SearchEngine, ReplacementPolicy> {
+public:
+  Cache(SearchEngine *s, ReplacementPolicy *r);
+  void putMany(int *addr, Data **cont, int n);
+  void readBatch(const int *addr, int n, Data **out);
+  void writeBatch(const int *addr, Data **cont, int n,
+                  Elem **deleted = nullptr);
+  // Syncs the file when a log is attached but leaves the log alone: it
+  // still covers dirty victims the caller may not have written back. Once
+  // they are, getLog()->truncate() empties it.
+  bool snapshot(const string &path, bool withEngine = true);
+  bool restore(const string &path); // only into an empty cache
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "Trace.h"
+
+// Predicted LRU hit ratio of a trace at many capacities at once:
+//   mrc [--rate R] [--max-keys N] [--capacities 64,128,...] [--points N]
+//       [--ops R|RW|RUW] [--format console|csv] TRACE
+// TRACE is a text or binary trace. Only the operations named by --ops
+// are references, reads by default, as in the online estimator. --rate 1
+// gives the exact curve. Without --capacities the curve is printed at
+// --points capacities spread up to the largest reuse distance seen.
+
+vector<int> parseList(const string &s) {
+  vector<int> out;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ',')) {
+    out.push_back(stoi(item));
+  }
+  return out;
+}
+
+int main(int argc, char *argv[]) {
+  double rate = 0.01;
+  size_t maxKeys = 0;
+  int points = 20;
+  string capacities, ops = "R", format = "console", path;
+  for (int i = 1; i < argc; i++) {
+    string flag = argv[i];
+    if (flag.compare(0, 2, "--") != 0) {
+      path = flag;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      cerr << "missing value for " << flag << endl;
+      return 1;
+    }
+    string value = argv[++i];
+    if (flag == "--rate") {
+      rate = stod(value);
+    } else if (flag == "--max-keys") {
+      maxKeys = stoul(value);
+    } else if (flag == "--capacities") {
+      capacities = value;
+    } else if (flag == "--points") {
+      points = stoi(value);
+    } else if (flag == "--ops") {
+      ops = value;
+    } else if (flag == "--format") {
+      format = value;
+    } else {
+      cerr << "unknown flag " << flag << endl;
+      return 1;
+    }
+  }
+  vector<TraceRecord> trace;
+  if (path.empty() || !readTrace(path, trace)) {
+    cerr << "cannot read trace " << path << endl;
+    return 1;
+  }
+  Shards mrc(rate, maxKeys);
+  for (const TraceRecord &rec : trace) {
+    if (ops.find(rec.code) != string::npos) {
+      mrc.access(rec.addr);
+    }
+  }
+  vector<int> caps =
+      capacities.empty() ? mrc.defaultCapacities(points) : parseList(capacities);
+  if (format == "csv") {
+    cout << "capacity,hit_ratio,miss_ratio" << endl;
+    for (int capacity : caps) {
+      double hit = mrc.hitRatio(capacity);
+      cout << capacity << "," << hit << "," << 1 - hit << endl;
+    }
+  } else {
+    mrc.print(cout, caps);
+  }
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include "main.h"
+#include "Cache.cpp"
+#include "Cache.h"
+#include "Simulate.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Replays many traces at once, each against its own Cache, and checks
+// every output against an expected file:
+//   replay [--jobs N] [--expected DIR] TRACE[=EXPECTED]...
+// With --expected DIR a trace's expected output is DIR/<trace file name>
+// unless one is given after '='. Traces without an expected file are only
+// timed. Exits with 1 if any output differs. The regression traces run
+// as: replay --expected traces/expected traces/*.txt
+
+struct Job {
+  string trace, expected;
+  string status, detail;
+  double ms;
+};
+
+string baseName(const string &path) {
+  size_t slash = path.find_last_of('/');
+  return (slash == string::npos) ? path : path.substr(slash + 1);
+}
+
+vector<string> lines(istream &in) {
+  vector<string> out;
+  string line;
+  while (getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    out.push_back(line);
+  }
+  return out;
+}
+
+// first difference as "line N: expected ... got ...", empty if none
+string diff(const vector<string> &expected, const vector<string> &actual) {
+  size_t n = max(expected.size(), actual.size());
+  for (size_t i = 0; i < n; i++) {
+    const string *e = (i < expected.size()) ? &expected[i] : nullptr;
+    const string *a = (i < actual.size()) ? &actual[i] : nullptr;
+    if (e == nullptr || a == nullptr || *e != *a) {
+      return "line " + to_string(i + 1) + ": expected " +
+             (e ? "\"" + *e + "\"" : string("end of output")) + " got " +
+             (a ? "\"" + *a + "\"" : string("end of output"));
+    }
+  }
+  return "";
+}
+
+void run(Job &job) {
+  ifstream ifs(job.trace);
+  if (!ifs) {
+    job.status = "ERROR";
+    job.detail = "cannot open trace";
+    return;
+  }
+  stringstream out;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  simulate(ifs, out);
+  job.ms = chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                           start)
+               .count();
+  if (job.expected.empty()) {
+    job.status = "RAN";
+    return;
+  }
+  ifstream expected(job.expected);
+  if (!expected) {
+    job.status = "ERROR";
+    job.detail = "cannot open " + job.expected;
+    return;
+  }
+  out.seekg(0);
+  job.detail = diff(lines(expected), lines(out));
+  job.status = job.detail.empty() ? "PASS" : "FAIL";
+}
+
+int main(int argc, char *argv[]) {
+  int jobs = max(1u, thread::hardware_concurrency());
+  string expectedDir;
+  vector<Job> work;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if ((arg == "--jobs" || arg == "--expected") && i + 1 < argc) {
+      if (arg == "--jobs") {
+        jobs = max(1, atoi(argv[++i]));
+      } else {
+        expectedDir = argv[++i];
+      }
+      continue;
+    }
+    Job job;
+    job.ms = 0;
+    size_t eq = arg.find('=');
+    job.trace = arg.substr(0, eq);
+    if (eq != string::npos) {
+      job.expected = arg.substr(eq + 1);
+    } else if (!expectedDir.empty()) {
+      job.expected = expectedDir + "/" + baseName(job.trace);
+    }
+    work.push_back(job);
+  }
+  if (work.empty()) {
+    cerr << "usage: replay [--jobs N] [--expected DIR] TRACE[=EXPECTED]..."
+         << endl;
+    return 1;
+  }
+  // a fixed pool of workers taking the next trace until none are left
+  atomic<size_t> next(0);
+  vector<thread> pool;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int t = 0; t < min(jobs, (int)work.size()); t++) {
+    pool.push_back(thread([&] {
+      for (size_t i = next++; i < work.size(); i = next++) {
+        run(work[i]);
+      }
+    }));
+  }
+  for (thread &t : pool) {
+    t.join();
+  }
+  double wall = chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                                start)
+                    .count();
+  int passed = 0, failed = 0;
+  for (const Job &job : work) {
+    cout << job.status << "\t" << job.ms << " ms\t" << job.trace;
+    if (!job.detail.empty()) {
+      cout << "\t" << job.detail;
+    }
+    cout << endl;
+    passed += job.status == "PASS";
+    failed += job.status == "FAIL" || job.status == "ERROR";
+  }
+  cout << work.size() << " traces, " << passed << " passed, " << failed
+       << " failed, " << wall << " ms on " << min(jobs, (int)work.size())
+       << " threads" << endl;
+  return failed > 0;
+}
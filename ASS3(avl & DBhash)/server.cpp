@@ -0,0 +1,207 @@
+#include "main.h"
+#include "Cache.cpp"
+#include "Cache.h"
+#include "Protocol.h"
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// One cache shared by local processes over a Unix domain socket:
+//   server [--socket PATH] [--capacity N] [--engine AVL|DBHashing]
+//          [--policy LRU|LFU|FIFO|MRU]
+// A single thread serves every connection from an epoll loop. All the
+// requests that have arrived on a connection are run as one batch and
+// their replies go out in one write, so pipelining clients pay for a
+// system call per batch rather than per request. A batch stops once its
+// replies pass HIGH_WATER bytes, and the connection is not read from again
+// until they drain, so a client that sends without reading cannot make the
+// server buffer more than a few values for it.
+
+struct Connection {
+  int fd;
+  string in, out;
+  uint32_t events; // registered with epoll
+  bool closing;    // the peer is done sending: close once out is written
+};
+
+// bytes a connection may have waiting in either direction before it is
+// no longer read from; room for a whole request of the largest value
+const size_t HIGH_WATER = 2 * MAX_VALUE;
+
+volatile sig_atomic_t stopping = 0;
+
+void stop(int) { stopping = 1; }
+
+int setNonBlocking(int fd) {
+  return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// runs every whole request in c.in; false on a malformed one
+bool serve(Cache &cache, Connection &c) {
+  size_t off = 0, size;
+  while (c.out.size() < HIGH_WATER &&
+         (size = messageSize<WireRequest>(c.in.data() + off,
+                                          c.in.size() - off)) > 0) {
+    WireRequest r;
+    memcpy(&r, c.in.data() + off, sizeof(r));
+    const unsigned char *bytes =
+        (const unsigned char *)c.in.data() + off + sizeof(r);
+    off += size;
+    if (r.size > MAX_VALUE) {
+      return false; // even if it has all arrived
+    }
+    if (r.op == OP_READ) {
+      Data *data = cache.read(r.addr);
+      appendReply(c.out, data ? REPLY_HIT : REPLY_MISS, r.addr, data, true);
+    } else if ((r.op == OP_PUT || r.op == OP_WRITE) && validType(r.type)) {
+      Data *data = makeData((DataType)r.type, bytes, r.size);
+      Elem *victim = (r.op == OP_PUT) ? cache.put(r.addr, data)
+                                      : cache.write(r.addr, data);
+      if (victim != nullptr) {
+        appendReply(c.out, REPLY_EVICTED, victim->addr, victim->data,
+                    victim->sync);
+      } else {
+        appendReply(c.out, REPLY_OK, r.addr, nullptr, true);
+      }
+      delete victim;
+    } else {
+      return false;
+    }
+  }
+  c.in.erase(0, off);
+  if (c.in.size() >= sizeof(WireRequest)) {
+    WireRequest r; // a value larger than any may be is never waited for
+    memcpy(&r, c.in.data(), sizeof(r));
+    return r.size <= MAX_VALUE;
+  }
+  return true;
+}
+
+// writes what it can of c.out; false if the connection is broken
+bool drain(Connection &c) {
+  size_t off = 0;
+  while (off < c.out.size()) {
+    ssize_t n = ::write(c.fd, c.out.data() + off, c.out.size() - off);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else if (n <= 0) {
+      return false;
+    }
+    off += n;
+  }
+  c.out.erase(0, off);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  string path = "/tmp/avlcache.sock", engine = "AVL", policy = "LRU";
+  int capacity = 1 << 16;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    string flag = argv[i], value = argv[i + 1];
+    if (flag == "--socket") {
+      path = value;
+    } else if (flag == "--capacity") {
+      capacity = stoi(value);
+    } else if (flag == "--engine") {
+      engine = value;
+    } else if (flag == "--policy") {
+      policy = value;
+    } else {
+      cerr << "unknown flag " << flag << endl;
+      return 1;
+    }
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(sa.sun_path)) {
+    cerr << "socket path too long" << endl;
+    return 1;
+  }
+  memcpy(sa.sun_path, path.c_str(), path.size());
+  unlink(path.c_str());
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 || bind(listener, (sockaddr *)&sa, sizeof(sa)) != 0 ||
+      listen(listener, 128) != 0) {
+    cerr << "cannot listen on " << path << endl;
+    return 1;
+  }
+  setNonBlocking(listener);
+  Cache cache(makeEngine(engine, capacity), makePolicy(policy, capacity));
+  int ep = epoll_create1(0);
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr; // the listener
+  epoll_ctl(ep, EPOLL_CTL_ADD, listener, &ev);
+  cerr << "serving " << policy << " " << engine << " capacity " << capacity
+       << " on " << path << endl;
+
+  epoll_event events[64];
+  char chunk[1 << 16];
+  while (!stopping) {
+    int n = epoll_wait(ep, events, 64, -1);
+    for (int i = 0; i < n; i++) {
+      Connection *c = (Connection *)events[i].data.ptr;
+      if (c == nullptr) {
+        int fd;
+        while ((fd = accept(listener, nullptr, nullptr)) >= 0) {
+          setNonBlocking(fd);
+          Connection *nc = new Connection{fd, "", "", EPOLLIN, false};
+          epoll_event cev;
+          cev.events = EPOLLIN;
+          cev.data.ptr = nc;
+          epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev);
+        }
+        continue;
+      }
+      bool alive = true;
+      if (!c->closing && c->out.size() < HIGH_WATER &&
+          (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        ssize_t got = 1;
+        while (c->in.size() < HIGH_WATER &&
+               (got = ::read(c->fd, chunk, sizeof(chunk))) > 0) {
+          c->in.append(chunk, got);
+        }
+        // requests before a hang-up are still answered, and their replies
+        // written out before the connection is closed
+        c->closing = got == 0;
+        alive = got >= 0 || errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      // a batch cut short by the high-water mark goes on as its replies
+      // drain, here or when the socket is next writable
+      do {
+        alive = serve(cache, *c) && alive;
+        alive = drain(*c) && alive;
+      } while (alive && c->out.empty() &&
+               messageSize<WireRequest>(c->in.data(), c->in.size()) > 0);
+      if (!alive || (c->closing && c->out.empty())) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, nullptr);
+        close(c->fd);
+        delete c;
+        continue;
+      }
+      // only wait to write if blocked, and stop reading after a hang-up or
+      // while either buffer is over the high-water mark
+      bool paused = c->closing || c->out.size() >= HIGH_WATER ||
+                    c->in.size() >= HIGH_WATER;
+      uint32_t want = (paused ? 0u : (uint32_t)EPOLLIN) |
+                      (c->out.empty() ? 0u : (uint32_t)EPOLLOUT);
+      if (c->events != want) {
+        c->events = want;
+        epoll_event cev;
+        cev.events = want;
+        cev.data.ptr = c;
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &cev);
+      }
+    }
+  }
+  close(ep);
+  close(listener);
+  unlink(path.c_str());
+  return 0;
+}
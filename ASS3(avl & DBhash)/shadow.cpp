@@ -0,0 +1,98 @@
+#include "main.h"
+#include "Cache.cpp"
+#include "Cache.h"
+#include "Ghost.h"
+
+// Hit ratios of one trace under several policies, replayed in parallel
+// through key-only ghost caches:
+//   shadow [--capacity N] [--policies LRU,LFU,FIFO,MRU]
+//          [--admission none,doorkeeper,tinylfu]
+//          [--engine AVL|DBHashing] [--format console|csv] TRACE
+// The capacity defaults to the M command of a text trace.
+
+vector<string> split(const string &s) {
+  vector<string> out;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ',')) {
+    out.push_back(item);
+  }
+  return out;
+}
+
+// the M command of a text trace, 0 if it has none
+int traceCapacity(const string &path) {
+  ifstream ifs(path);
+  string line;
+  while (getline(ifs, line)) {
+    stringstream ss(line);
+    string code;
+    int capacity;
+    if (ss >> code && code == "M" && ss >> capacity) {
+      return capacity;
+    }
+    if (code == "R" || code == "U" || code == "W") {
+      break;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int capacity = 0;
+  string policies = "LRU,LFU,FIFO,MRU", admission = "none", engine = "AVL";
+  string format = "console";
+  string path;
+  for (int i = 1; i < argc; i++) {
+    string flag = argv[i];
+    if (flag.compare(0, 2, "--") != 0) {
+      path = flag;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      cerr << "missing value for " << flag << endl;
+      return 1;
+    }
+    string value = argv[++i];
+    if (flag == "--capacity") {
+      capacity = stoi(value);
+    } else if (flag == "--policies") {
+      policies = value;
+    } else if (flag == "--admission") {
+      admission = value;
+    } else if (flag == "--engine") {
+      engine = value;
+    } else if (flag == "--format") {
+      format = value;
+    } else {
+      cerr << "unknown flag " << flag << endl;
+      return 1;
+    }
+  }
+  vector<TraceRecord> trace;
+  if (path.empty() || !readTrace(path, trace)) {
+    cerr << "cannot read trace " << path << endl;
+    return 1;
+  }
+  if (capacity <= 0) {
+    capacity = traceCapacity(path);
+  }
+  if (capacity <= 0) {
+    cerr << "no capacity: pass --capacity" << endl;
+    return 1;
+  }
+  vector<GhostResult> results =
+      shadow(trace, split(policies), engine, capacity, split(admission));
+  const char *sep = (format == "csv") ? "," : "\t";
+  cout << "policy" << sep << "admission" << sep << "reads" << sep
+       << "read_hit_ratio" << sep << "writes" << sep << "write_hit_ratio"
+       << sep << "evictions" << sep << "rejected" << sep << "seconds" << endl;
+  for (const GhostResult &r : results) {
+    const CacheStats &s = r.stats;
+    cout << r.policy << sep << r.admission << sep << s.reads << sep
+         << s.hitRatio() << sep << s.writes << sep
+         << (s.writes ? (double)s.writeHits / s.writes : 0) << sep
+         << s.evictions << sep << s.rejected << sep << r.seconds << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include "main.h"
+#include "Cache.cpp"
+#include "Cache.h"
+#include "Shm.h"
+#include "Simulate.h"
+#include <random>
+#include <sys/wait.h>
+
+// Runs against a cache in shared memory that outlives each process:
+//   shmcache create NAME CAPACITY [VALUE_BYTES]
+//   shmcache trace NAME TRACE      R, U, W, P and C lines of a trace
+//   shmcache stress NAME PROCESSES OPERATIONS
+//   shmcache stats NAME
+//   shmcache remove NAME
+// stress forks processes that read and write random addresses at once;
+// every value written for addr is addr, so any other value read is an
+// error.
+
+void trace(SharedCache *c, istream &in) {
+  string s;
+  while (getline(in, s)) {
+    stringstream ss(s);
+    string code, tmp;
+    int addr;
+    ss >> code;
+    if (code.empty()) {
+      continue;
+    }
+    switch (code[0]) {
+    case 'R': {
+      ss >> addr;
+      Data *res = c->read(addr);
+      if (res == nullptr) {
+        ss >> tmp;
+        delete c->put(addr, getData(tmp));
+      } else {
+        cout << res->getValue() << endl;
+      }
+      delete res;
+      break;
+    }
+    case 'U':
+      ss >> addr >> tmp;
+      delete c->put(addr, getData(tmp));
+      break;
+    case 'W':
+      ss >> addr >> tmp;
+      delete c->write(addr, getData(tmp));
+      break;
+    case 'P':
+      cout << "Print replacement buffer\n";
+      c->printRP(cout);
+      break;
+    case 'C':
+      cout << "Print cache stats\n";
+      c->printStats(cout);
+      break;
+    }
+  }
+}
+
+int stress(const string &name, int processes, int operations) {
+  for (int p = 0; p < processes; p++) {
+    if (fork() == 0) {
+      SharedCache *c = SharedCache::attach(name);
+      if (c == nullptr) {
+        _exit(2);
+      }
+      mt19937 rng(p + 1);
+      int wrong = 0, range = 2 * c->getCapacity();
+      for (int i = 0; i < operations; i++) {
+        int addr = (int)(rng() % range);
+        if (rng() % 4 == 0) {
+          delete c->write(addr, new Int(addr));
+          continue;
+        }
+        Data *data = c->read(addr);
+        if (data == nullptr) {
+          delete c->put(addr, new Int(addr));
+        } else if (data->getBits() != addr) {
+          wrong++;
+        }
+        delete data;
+      }
+      delete c;
+      _exit(wrong > 0);
+    }
+  }
+  int failed = 0, status;
+  while (wait(&status) > 0) {
+    failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+  cout << processes << " processes, " << failed << " failed" << endl;
+  return failed > 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    cerr << "usage: shmcache create|trace|stress|stats|remove NAME ..."
+         << endl;
+    return 1;
+  }
+  string command = argv[1], name = argv[2];
+  if (command == "create" && argc >= 4) {
+    SharedCache *c = SharedCache::create(name, atoi(argv[3]),
+                                         (argc >= 5) ? atoi(argv[4]) : 64);
+    if (c == nullptr) {
+      cerr << "cannot create " << name << endl;
+      return 1;
+    }
+    delete c;
+    return 0;
+  } else if (command == "remove") {
+    return !SharedCache::remove(name);
+  }
+  SharedCache *c = SharedCache::attach(name);
+  if (c == nullptr) {
+    cerr << "cannot attach " << name << endl;
+    return 1;
+  }
+  int status = 0;
+  if (command == "trace" && argc >= 4) {
+    ifstream ifs(argv[3]);
+    trace(c, ifs);
+  } else if (command == "stress" && argc >= 5) {
+    status = stress(name, atoi(argv[3]), atoi(argv[4]));
+  } else if (command == "stats") {
+    c->printStats(cout);
+  } else {
+    cerr << "unknown command " << command << endl;
+    status = 1;
+  }
+  delete c;
+  return status;
+}
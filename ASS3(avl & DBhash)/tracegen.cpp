@@ -0,0 +1,222 @@
+#include "Trace.h"
+#include <random>
+
+// Synthetic traces in the simulate text format, or binary with --binary:
+//   tracegen [--ops N] [--keys N] [--dist zipf,uniform,hotspot,scan,loop]
+//            [--phase-length N] [--phase-shift N] [--theta T]
+//            [--hot-keys F] [--hot-ops F] [--loop-length N]
+//            [--reads F] [--writes F] [--types Int,Float,Bool,Address]
+//            [--capacity N] [--engine "A"|"D13 31"] [--policy 1-4]
+//            [--print] [--seed N] [--binary] [--out FILE]
+// Each --dist entry is one phase of --phase-length operations. Phases cycle
+// through the list and each one moves the key range by --phase-shift.
+// Operations are reads with probability --reads, writes with --writes and
+// puts otherwise. Text traces hold Int values only, the one type simulate
+// reads back as written; Float, Bool and Address need --binary.
+
+struct Options {
+  long long ops = 100000, phaseLength = 0;
+  int keys = 1000, phaseShift = 0, loopLength = 0, capacity = 0, policy = 0;
+  double theta = 0.99, hotKeys = 0.2, hotOps = 0.8, reads = 0.8, writes = 0.1;
+  string dist = "zipf", types = "Int", engine, out;
+  bool print = false, binary = false;
+  unsigned seed = 1;
+};
+
+// key offsets in [0, keys) for one phase
+class KeyGen {
+  string dist;
+  int keys, loopLength, hot;
+  double hotOps;
+  long long pos;
+  Zipf *zipf;
+
+public:
+  KeyGen(const string &dist, const Options &o)
+      : dist(dist), keys(o.keys), pos(0), zipf(nullptr) {
+    loopLength = (o.loopLength > 0) ? min(o.loopLength, keys) : keys;
+    hot = max(1, (int)(keys * o.hotKeys));
+    hotOps = o.hotOps;
+    if (dist == "zipf") {
+      zipf = new Zipf(keys, o.theta);
+    }
+  }
+  ~KeyGen() { delete zipf; }
+  int next(mt19937 &rng) {
+    uniform_real_distribution<double> unit(0, 1);
+    if (dist == "zipf") {
+      return zipf->next(unit(rng));
+    } else if (dist == "hotspot") {
+      // hotOps of the accesses go to the first hot keys
+      if (unit(rng) < hotOps || hot == keys) {
+        return (int)(rng() % hot);
+      }
+      return hot + (int)(rng() % (keys - hot));
+    } else if (dist == "scan") {
+      return (int)(pos++ % keys);
+    } else if (dist == "loop") {
+      return (int)(pos++ % loopLength);
+    }
+    return (int)(rng() % keys);
+  }
+};
+
+vector<string> split(const string &s) {
+  vector<string> out;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ',')) {
+    out.push_back(item);
+  }
+  return out;
+}
+
+DataType typeOf(const string &name) {
+  if (name == "Float") {
+    return FLOAT_DATA;
+  } else if (name == "Bool") {
+    return BOOL_DATA;
+  } else if (name == "Address") {
+    return ADDRESS_DATA;
+  }
+  return INT_DATA;
+}
+
+int randomBits(DataType type, mt19937 &rng) {
+  if (type == FLOAT_DATA) {
+    float f = (rng() % 10000) / 4.0f;
+    int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+  } else if (type == BOOL_DATA) {
+    return rng() % 2;
+  }
+  return (int)(rng() % 1000);
+}
+
+void generate(const Options &o, ostream &os) {
+  mt19937 rng(o.seed);
+  uniform_real_distribution<double> unit(0, 1);
+  vector<KeyGen *> phases;
+  for (const string &dist : split(o.dist)) {
+    phases.push_back(new KeyGen(dist, o));
+  }
+  vector<DataType> types;
+  for (const string &name : split(o.types)) {
+    types.push_back(typeOf(name));
+  }
+  if (o.binary) {
+    os.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  } else {
+    if (o.capacity > 0) {
+      os << "M " << o.capacity << "\n";
+    }
+    if (!o.engine.empty()) {
+      os << "S " << o.engine << "\n";
+    }
+    if (o.policy > 0) {
+      os << "T " << o.policy << "\n";
+    }
+  }
+  for (long long i = 0; i < o.ops; i++) {
+    long long phase = (o.phaseLength > 0) ? i / o.phaseLength : 0;
+    int offset = (int)(phase * o.phaseShift % (1 << 30));
+    double u = unit(rng);
+    TraceRecord rec = {(u < o.reads)              ? 'R'
+                       : (u < o.reads + o.writes) ? 'W'
+                                                  : 'U',
+                       (char)types[rng() % types.size()],
+                       {0, 0},
+                       0,
+                       0};
+    rec.addr = offset + phases[phase % phases.size()]->next(rng);
+    rec.bits = randomBits((DataType)rec.type, rng);
+    if (o.binary) {
+      os.write((const char *)&rec, sizeof(rec));
+    } else {
+      os << rec.code << " " << rec.addr << " "
+         << formatValue((DataType)rec.type, rec.bits) << "\n";
+    }
+  }
+  if (o.print && !o.binary) {
+    os << "P\nE\n";
+  }
+  for (KeyGen *gen : phases) {
+    delete gen;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    string flag = argv[i];
+    if (flag == "--print") {
+      o.print = true;
+      continue;
+    } else if (flag == "--binary") {
+      o.binary = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      cerr << "missing value for " << flag << endl;
+      return 1;
+    }
+    string value = argv[++i];
+    if (flag == "--ops") {
+      o.ops = stoll(value);
+    } else if (flag == "--keys") {
+      o.keys = stoi(value);
+    } else if (flag == "--dist") {
+      o.dist = value;
+    } else if (flag == "--phase-length") {
+      o.phaseLength = stoll(value);
+    } else if (flag == "--phase-shift") {
+      o.phaseShift = stoi(value);
+    } else if (flag == "--theta") {
+      o.theta = stod(value);
+    } else if (flag == "--hot-keys") {
+      o.hotKeys = stod(value);
+    } else if (flag == "--hot-ops") {
+      o.hotOps = stod(value);
+    } else if (flag == "--loop-length") {
+      o.loopLength = stoi(value);
+    } else if (flag == "--reads") {
+      o.reads = stod(value);
+    } else if (flag == "--writes") {
+      o.writes = stod(value);
+    } else if (flag == "--types") {
+      o.types = value;
+    } else if (flag == "--capacity") {
+      o.capacity = stoi(value);
+    } else if (flag == "--engine") {
+      o.engine = value;
+    } else if (flag == "--policy") {
+      o.policy = stoi(value);
+    } else if (flag == "--seed") {
+      o.seed = stoul(value);
+    } else if (flag == "--out") {
+      o.out = value;
+    } else {
+      cerr << "unknown flag " << flag << endl;
+      return 1;
+    }
+  }
+  if (o.keys <= 0 || o.dist.empty() || o.types.empty()) {
+    cerr << "--keys, --dist and --types must not be empty" << endl;
+    return 1;
+  }
+  for (const string &name : split(o.types)) {
+    if (!o.binary && typeOf(name) != INT_DATA) {
+      cerr << "text traces hold Int values only, " << name
+           << " needs --binary" << endl;
+      return 1;
+    }
+  }
+  if (o.out.empty()) {
+    generate(o, cout);
+  } else {
+    ofstream ofs(o.out, ios::binary);
+    generate(o, ofs);
+  }
+  return 0;
+}